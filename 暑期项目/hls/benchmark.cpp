@@ -0,0 +1,356 @@
+/*
+ * File:   benchmark.cpp
+ *
+ * Compression benchmark of both cores over a corpus, one CSV row per file.
+ */
+
+#include "stream_io.h"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef BENCHMARK_ZLIB
+#include <zlib.h>
+#endif
+
+/*
+ * usage: benchmark [-f format] [-s size] [-z] [directory]
+ *
+ * Each regular file of the directory is cut into jobs of MAX_JOB_SIZE bytes,
+ * compressed with Deflate() and decompressed with inflate(). Without a
+ * directory, a built-in corpus of 'size' bytes per file is generated
+ * instead: text, logs, JSON, binary records, random bytes and zeros.
+ *
+ * One CSV row is printed per file: the sizes and compression ratio, the
+ * predicted cycles and throughput of both cores from the cycle model
+ * (cycle_model.cpp, at MODEL_CLOCK_MHZ), and the round-trip verdict. The
+ * native build has no cycle model, so its rows leave the cycle columns out.
+ * The exit status is 1 if any file fails the round trip.
+ *
+ * With -z (built with -DBENCHMARK_ZLIB and -lz), each job is also compressed
+ * by zlib at levels 1, 6 and 9, in the same container, and the row has more
+ * columns: whether zlib decodes the output of the core, and per level the
+ * zlib size, the ratio of the core minus the ratio of zlib, and whether the
+ * inflate core decodes the zlib output. zlib sees the same jobs as the core,
+ * so the deltas are the cost of the shortcuts of the core (static Huffman,
+ * 4 KB window, LEN bytes matches, hash dictionaries), not of the job size.
+ * The inflate core rejects dynamic codes longer than its first level lookup.
+ */
+
+#define DEFAULT_CORPUS_SIZE 16384 // bytes of each generated file
+
+struct corpus_file
+{
+    string name;
+    string data;
+};
+
+#ifdef BENCHMARK_ZLIB
+static const int ZLIB_LEVELS[3] = {1, 6, 9};
+
+// windowBits of zlib for a container: raw, zlib, or gzip
+static int zlib_window_bits(unsigned format)
+{
+    return format == FORMAT_RAW ? -15 : format == FORMAT_ZLIB ? 15 : 31;
+}
+
+// Compress a job with zlib at 'level'
+static string zlib_compress(const string &data, int level, unsigned format)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, level, Z_DEFLATED, zlib_window_bits(format), 8, Z_DEFAULT_STRATEGY);
+
+    string output(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = (Bytef *)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef *)&output[0];
+    stream.avail_out = output.size();
+    deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    return output;
+}
+
+// Decompress a job with zlib; false if zlib rejects it or the output differs from 'expected'
+static bool zlib_check(const string &data, unsigned format, const string &expected)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    inflateInit2(&stream, zlib_window_bits(format));
+
+    string output(expected.size() + 1, '\0');
+    stream.next_in = (Bytef *)data.data();
+    stream.avail_in = data.size();
+    stream.next_out = (Bytef *)&output[0];
+    stream.avail_out = output.size();
+    int result = inflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    inflateEnd(&stream);
+
+    return result == Z_STREAM_END && output == expected;
+}
+#endif
+
+// Deterministic pseudo-random numbers (xorshift32), so the corpus is the same on every run
+static uint32_t next_random(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Generate the built-in corpus, 'size' bytes per file
+static vector<corpus_file> generate_corpus(unsigned size)
+{
+    static const char *words[] = {"the", "prefetcher", "graph", "traversal", "of", "memory", "breadth-first",
+                                  "search", "and", "cache", "stall", "rates", "data", "structures", "in", "a"};
+    static const char *levels[] = {"INFO", "INFO", "INFO", "WARN", "DEBUG", "ERROR"};
+    vector<corpus_file> corpus(6);
+    uint32_t state = 2016;
+    char line[160];
+
+    corpus[0].name = "text";
+    while (corpus[0].data.size() < size)
+    {
+        corpus[0].data += words[next_random(state) % 16];
+        corpus[0].data += next_random(state) % 12 == 0 ? ". " : " ";
+    }
+
+    corpus[1].name = "logs";
+    for (unsigned n = 0; corpus[1].data.size() < size; n++)
+    {
+        snprintf(line, sizeof(line), "2016-07-08 10:52:%02u.%03u %s worker-%u: job %u done in %u us\n",
+                 n / 1000 % 60, n % 1000, levels[next_random(state) % 6], next_random(state) % 8, n,
+                 next_random(state) % 5000);
+        corpus[1].data += line;
+    }
+
+    corpus[2].name = "json";
+    corpus[2].data = "[";
+    for (unsigned n = 0; corpus[2].data.size() < size; n++)
+    {
+        snprintf(line, sizeof(line), "{\"id\": %u, \"name\": \"user%u\", \"score\": %u, \"active\": %s},\n", n,
+                 next_random(state) % 1000, next_random(state) % 100, next_random(state) % 2 ? "true" : "false");
+        corpus[2].data += line;
+    }
+
+    corpus[3].name = "binary";
+    for (uint32_t n = 0; corpus[3].data.size() < size; n++)
+    {
+        // little-endian records: a counter, a small value and a flag word
+        uint32_t record[3] = {n, next_random(state) % 256, 0x00010000};
+        for (int k = 0; k < 12; k++)
+        {
+            corpus[3].data.push_back((char)(record[k / 4] >> (8 * (k % 4))));
+        }
+    }
+
+    corpus[4].name = "random";
+    for (unsigned n = 0; n < size; n++)
+    {
+        corpus[4].data.push_back((char)next_random(state));
+    }
+
+    corpus[5].name = "zeros";
+    corpus[5].data.assign(size, '\0');
+
+    for (int i = 0; i < 6; i++)
+    {
+        corpus[i].data.resize(size);
+    }
+
+    return corpus;
+}
+
+// Read the regular files of a directory, sorted by name
+static bool read_corpus(const char *path, vector<corpus_file> &corpus)
+{
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    struct stat info;
+
+    if (dir == NULL)
+        return false;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        string file_path = string(path) + "/" + entry->d_name;
+        if (stat(file_path.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+            continue;
+
+        ifstream file(file_path.c_str(), ios::binary);
+        stringstream content;
+        content << file.rdbuf();
+
+        corpus_file corpus_entry;
+        corpus_entry.name = entry->d_name;
+        corpus_entry.data = content.str();
+        corpus.push_back(corpus_entry);
+    }
+    closedir(dir);
+
+    sort(corpus.begin(), corpus.end(), [](const corpus_file &a, const corpus_file &b) { return a.name < b.name; });
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned format = FORMAT_RAW;
+    unsigned corpus_size = DEFAULT_CORPUS_SIZE;
+    const char *directory = NULL;
+    bool compare_zlib = false;
+    vector<corpus_file> corpus;
+    bool isFail = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            format = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            corpus_size = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-z") == 0)
+            compare_zlib = true;
+        else
+            directory = argv[i];
+    }
+
+#ifndef BENCHMARK_ZLIB
+    if (compare_zlib)
+    {
+        cerr << "-z needs a build with -DBENCHMARK_ZLIB and -lz" << endl;
+        return 1;
+    }
+#endif
+
+    if (directory == NULL)
+    {
+        corpus = generate_corpus(corpus_size);
+    }
+    else if (!read_corpus(directory, corpus))
+    {
+        cerr << "cannot open " << directory << endl;
+        return 1;
+    }
+
+    hls::stream<axi_word> input, output;
+    unsigned perf[PERF_NUM];
+    unsigned status, size;
+
+    cout << "file,bytes,compressed_bytes,ratio,";
+    if (MODEL_ENABLED)
+    {
+        cout << "deflate_cycles,deflate_bytes_per_cycle,deflate_MBps,inflate_cycles,inflate_bytes_per_cycle,"
+                "inflate_MBps,";
+    }
+    cout << "round_trip";
+#ifdef BENCHMARK_ZLIB
+    if (compare_zlib)
+    {
+        cout << ",zlib_decodes_core";
+        for (int l = 0; l < 3; l++)
+        {
+            cout << ",zlib" << ZLIB_LEVELS[l] << "_bytes,zlib" << ZLIB_LEVELS[l] << "_ratio_delta,core_decodes_zlib"
+                 << ZLIB_LEVELS[l];
+        }
+    }
+#endif
+    cout << endl;
+
+    for (unsigned f = 0; f < corpus.size(); f++)
+    {
+        const string &data = corpus[f].data;
+        unsigned jobs = data.size() == 0 ? 1 : (data.size() + MAX_JOB_SIZE - 1) / MAX_JOB_SIZE;
+        uint64_t compressed_bytes = 0, deflate_cycles, inflate_cycles;
+        vector<string> compressed(jobs);
+        bool pass = true;
+
+        /************************* Deflate compression ************************/
+        model_reset();
+        for (unsigned j = 0; j < jobs; j++)
+        {
+            string job = data.substr(j * MAX_JOB_SIZE, MAX_JOB_SIZE);
+            send_job(input, job);
+            Deflate(input, output, format, job.size(), perf);
+            compressed[j] = receive_job(output);
+            compressed_bytes += compressed[j].size();
+            model_end_job();
+        }
+        deflate_cycles = model_cycles();
+
+        /************************* inflate decompression **********************/
+        model_reset();
+        for (unsigned j = 0; j < jobs; j++)
+        {
+            send_job(input, compressed[j]);
+            inflate(input, output, format, status, size, perf);
+            string job = receive_job(output);
+            model_end_job();
+
+            job.resize(size < job.size() ? size : job.size());
+            pass &= status == INFLATE_OK && job == data.substr(j * MAX_JOB_SIZE, MAX_JOB_SIZE);
+        }
+        inflate_cycles = model_cycles();
+
+        double deflate_rate = deflate_cycles == 0 ? 0 : (double)data.size() / deflate_cycles;
+        double inflate_rate = inflate_cycles == 0 ? 0 : (double)data.size() / inflate_cycles;
+        double ratio = compressed_bytes == 0 ? 0 : (double)data.size() / compressed_bytes;
+
+        cout << corpus[f].name << "," << data.size() << "," << compressed_bytes << "," << ratio << ",";
+        if (MODEL_ENABLED)
+        {
+            cout << deflate_cycles << "," << deflate_rate << "," << deflate_rate * MODEL_CLOCK_MHZ << ","
+                 << inflate_cycles << "," << inflate_rate << "," << inflate_rate * MODEL_CLOCK_MHZ << ",";
+        }
+        cout << (pass ? "PASS" : "FAIL");
+
+#ifdef BENCHMARK_ZLIB
+        if (compare_zlib)
+        {
+            /********************* zlib decodes the core **********************/
+            bool zlib_decodes = true;
+            for (unsigned j = 0; j < jobs; j++)
+            {
+                zlib_decodes &= zlib_check(compressed[j], format, data.substr(j * MAX_JOB_SIZE, MAX_JOB_SIZE));
+            }
+            cout << "," << (zlib_decodes ? "PASS" : "FAIL");
+
+            /********************* zlib levels, the core decodes zlib *********/
+            for (int l = 0; l < 3; l++)
+            {
+                uint64_t zlib_bytes = 0;
+                bool core_decodes = true;
+                for (unsigned j = 0; j < jobs; j++)
+                {
+                    string job = data.substr(j * MAX_JOB_SIZE, MAX_JOB_SIZE);
+                    string zlib_job = zlib_compress(job, ZLIB_LEVELS[l], format);
+                    zlib_bytes += zlib_job.size();
+
+                    send_job(input, zlib_job);
+                    inflate(input, output, format, status, size, perf);
+                    string decoded = receive_job(output);
+                    decoded.resize(size < decoded.size() ? size : decoded.size());
+                    core_decodes &= status == INFLATE_OK && decoded == job;
+                }
+                model_reset(); // keep the cycle model of the next file clean
+
+                double zlib_ratio = zlib_bytes == 0 ? 0 : (double)data.size() / zlib_bytes;
+                cout << "," << zlib_bytes << "," << ratio - zlib_ratio << "," << (core_decodes ? "PASS" : "FAIL");
+            }
+        }
+#endif
+        cout << endl;
+
+        isFail |= !pass;
+    }
+
+    return isFail ? 1 : 0;
+}
@@ -0,0 +1,243 @@
+/*
+ * File:   checksum.cpp
+ *
+ * Checksums of the zlib (rfc1950) and gzip (rfc1952) containers.
+ */
+
+#include "deflate.h"
+
+/*
+ * Both checksums are computed over the uncompressed data at line rate, one
+ * stream word (STREAM_BYTES bytes) per cycle:
+ *
+ * 1. CRC-32 uses slice-by-N, N = STREAM_BYTES: the bytes of a word are looked
+ * up in N ROMs in parallel and the results are XORed. The ROMs are generated
+ * at compile time.
+ * 2. Adler-32 adds all bytes of a word in one step. The modulo 65521 is
+ * folded, using 65536 = 15 (mod 65521), so only shifts, adds and one
+ * conditional subtraction are needed.
+ *
+ * The last word of a job may be partial. It is processed byte by byte.
+ *
+ * The native build adds the bytes of a whole job at once instead
+ * (checksum_update_bytes()), and only to the checksum its container writes:
+ * slice-by-8 CRC-32 whatever the stream width, and Adler-32 16 bytes at a
+ * time on SSE2, with the modulo once per block of 4096 bytes.
+ */
+
+// CRC-32 (reflected polynomial 0xEDB88320) of one byte, k bits left to shift
+constexpr uint32_t crc32_bits(uint32_t c, unsigned k)
+{
+    return k == 0 ? c : crc32_bits((c & 0x1) ? 0xEDB88320 ^ (c >> 1) : c >> 1, k - 1);
+}
+
+// Advance a CRC table entry by one more zero byte
+constexpr uint32_t crc32_shift(uint32_t c)
+{
+    return (c >> 8) ^ crc32_bits(c & 0xFF, 8);
+}
+
+// CRC-32 of byte n followed by k zero bytes
+constexpr uint32_t crc32_slice(uint32_t n, unsigned k)
+{
+    return k == 0 ? crc32_bits(n, 8) : crc32_shift(crc32_slice(n, k - 1));
+}
+
+#define CRC_T0_ENTRY(n) crc32_slice(n, 0)
+#define CRC_T1_ENTRY(n) crc32_slice(n, 1)
+#define CRC_T2_ENTRY(n) crc32_slice(n, 2)
+#define CRC_T3_ENTRY(n) crc32_slice(n, 3)
+#define CRC_T4_ENTRY(n) crc32_slice(n, 4)
+#define CRC_T5_ENTRY(n) crc32_slice(n, 5)
+#define CRC_T6_ENTRY(n) crc32_slice(n, 6)
+#define CRC_T7_ENTRY(n) crc32_slice(n, 7)
+#define CRC_T8_ENTRY(n) crc32_slice(n, 8)
+#define CRC_T9_ENTRY(n) crc32_slice(n, 9)
+#define CRC_T10_ENTRY(n) crc32_slice(n, 10)
+#define CRC_T11_ENTRY(n) crc32_slice(n, 11)
+#define CRC_T12_ENTRY(n) crc32_slice(n, 12)
+#define CRC_T13_ENTRY(n) crc32_slice(n, 13)
+#define CRC_T14_ENTRY(n) crc32_slice(n, 14)
+#define CRC_T15_ENTRY(n) crc32_slice(n, 15)
+
+// Slice-by-N ROMs: CRC_TABLE[k][n] is the CRC of byte n followed by k zero bytes
+static const uint32_t CRC_TABLE[STREAM_BYTES][256] = {
+    {ROM_256(CRC_T0_ENTRY, 0)},
+    {ROM_256(CRC_T1_ENTRY, 0)},
+    {ROM_256(CRC_T2_ENTRY, 0)},
+    {ROM_256(CRC_T3_ENTRY, 0)},
+#if STREAM_BYTES > 4
+    {ROM_256(CRC_T4_ENTRY, 0)},
+    {ROM_256(CRC_T5_ENTRY, 0)},
+    {ROM_256(CRC_T6_ENTRY, 0)},
+    {ROM_256(CRC_T7_ENTRY, 0)},
+#endif
+#if STREAM_BYTES > 8
+    {ROM_256(CRC_T8_ENTRY, 0)},
+    {ROM_256(CRC_T9_ENTRY, 0)},
+    {ROM_256(CRC_T10_ENTRY, 0)},
+    {ROM_256(CRC_T11_ENTRY, 0)},
+    {ROM_256(CRC_T12_ENTRY, 0)},
+    {ROM_256(CRC_T13_ENTRY, 0)},
+    {ROM_256(CRC_T14_ENTRY, 0)},
+    {ROM_256(CRC_T15_ENTRY, 0)},
+#endif
+};
+
+// x mod 65521 for x < 2^24
+static uint32_t adler_mod(uint32_t x)
+{
+#pragma HLS INLINE
+    x = (x >> 16) * 15 + (x & 0xFFFF);
+    return x >= 65521 ? x - 65521 : x;
+}
+
+void checksum_init(checksum_state &state)
+{
+    state.crc = 0xFFFFFFFF;
+    state.adler_a = 1;
+    state.adler_b = 0;
+    state.size = 0;
+
+    return;
+}
+
+// Add the first valid_bytes bytes of a stream word (first byte at the top)
+void checksum_update(checksum_state &state, stream_data_t word, unsigned valid_bytes)
+{
+#pragma HLS INLINE
+#pragma HLS ARRAY_PARTITION variable = CRC_TABLE complete dim = 1
+
+    if (valid_bytes == STREAM_BYTES)
+    {
+        // slice-by-N CRC: the register is folded into the first 4 bytes
+        uint32_t crc = state.crc ^ byte_swap((uint32_t)(word >> (STREAM_WIDTH - 32)));
+        uint32_t next_crc = 0;
+        uint32_t a = state.adler_a, sum_a = 0, sum_b = 0;
+
+    CHECKSUM_WORD_BYTES:
+        for (unsigned i = 0; i < STREAM_BYTES; i++)
+        {
+#pragma HLS UNROLL
+            uint8_t data = stream_byte(word, i);
+            uint8_t index = i < 4 ? (uint8_t)(crc >> (8 * i)) : data;
+            next_crc ^= CRC_TABLE[STREAM_BYTES - 1 - i][index];
+
+            // all Adler steps of the word at once
+            sum_a += data;
+            sum_b += (STREAM_BYTES - i) * data;
+        }
+
+        state.crc = next_crc;
+        state.adler_a = adler_mod(a + sum_a);
+        state.adler_b = adler_mod(state.adler_b + STREAM_BYTES * a + sum_b);
+    }
+    else
+    {
+        // the last partial word
+    CHECKSUM_LAST_BYTES:
+        for (unsigned i = 0; i < STREAM_BYTES - 1; i++)
+        {
+#pragma HLS UNROLL
+            if (i < valid_bytes)
+            {
+                uint8_t data = stream_byte(word, i);
+                state.crc = (state.crc >> 8) ^ CRC_TABLE[0][(state.crc ^ data) & 0xFF];
+                state.adler_a = adler_mod(state.adler_a + data);
+                state.adler_b = adler_mod(state.adler_b + state.adler_a);
+            }
+        }
+    }
+
+    state.size += valid_bytes;
+
+    return;
+}
+
+#ifdef DEFLATE_NATIVE
+static const uint32_t CRC_TABLE_8[8][256] = {
+    {ROM_256(CRC_T0_ENTRY, 0)}, {ROM_256(CRC_T1_ENTRY, 0)}, {ROM_256(CRC_T2_ENTRY, 0)}, {ROM_256(CRC_T3_ENTRY, 0)},
+    {ROM_256(CRC_T4_ENTRY, 0)}, {ROM_256(CRC_T5_ENTRY, 0)}, {ROM_256(CRC_T6_ENTRY, 0)}, {ROM_256(CRC_T7_ENTRY, 0)},
+};
+
+// Adler-32 of a block of at most 4096 bytes, from a and b below 65521
+static void adler32_block(uint32_t &a, uint32_t &b, const uint8_t *bytes, unsigned size)
+{
+    unsigned k = 0;
+
+#if defined(__SSE2__)
+    // b gains size * a, 16 times the sums of the chunks before each chunk,
+    // and the bytes of each chunk weighted 16..1
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weight_low = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+    const __m128i weight_high = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+    __m128i sum = zero, sums_before = zero, weighted = zero;
+    uint32_t chunks[4];
+
+    for (; k + 16 <= size; k += 16)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(bytes + k));
+        sums_before = _mm_add_epi32(sums_before, sum);
+        sum = _mm_add_epi32(sum, _mm_sad_epu8(chunk, zero));
+        weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpacklo_epi8(chunk, zero), weight_low));
+        weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpackhi_epi8(chunk, zero), weight_high));
+    }
+    b += k * a;
+    _mm_storeu_si128((__m128i *)chunks, _mm_add_epi32(_mm_slli_epi32(sums_before, 4), weighted));
+    b += chunks[0] + chunks[1] + chunks[2] + chunks[3];
+    _mm_storeu_si128((__m128i *)chunks, sum);
+    a += chunks[0] + chunks[2];
+#endif
+    for (; k < size; k++)
+    {
+        a += bytes[k];
+        b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+}
+
+void checksum_update_bytes(checksum_state &state, const uint8_t *bytes, unsigned size, unsigned container)
+{
+    if (container == FORMAT_GZIP)
+    {
+        uint32_t crc = state.crc;
+        unsigned k = 0;
+
+        for (; k + 8 <= size; k += 8)
+        {
+            uint32_t low = crc ^ (bytes[k] | bytes[k + 1] << 8 | bytes[k + 2] << 16 | (uint32_t)bytes[k + 3] << 24);
+            crc = CRC_TABLE_8[7][low & 0xFF] ^ CRC_TABLE_8[6][(low >> 8) & 0xFF] ^ CRC_TABLE_8[5][(low >> 16) & 0xFF] ^
+                  CRC_TABLE_8[4][low >> 24] ^ CRC_TABLE_8[3][bytes[k + 4]] ^ CRC_TABLE_8[2][bytes[k + 5]] ^
+                  CRC_TABLE_8[1][bytes[k + 6]] ^ CRC_TABLE_8[0][bytes[k + 7]];
+        }
+        for (; k < size; k++)
+        {
+            crc = (crc >> 8) ^ CRC_TABLE_8[0][(crc ^ bytes[k]) & 0xFF];
+        }
+        state.crc = crc;
+    }
+    else if (container == FORMAT_ZLIB)
+    {
+        // a block of 4096 bytes adds less than 2^32 to b
+        for (unsigned block = 0; block < size; block += 4096)
+        {
+            adler32_block(state.adler_a, state.adler_b, bytes + block, size - block < 4096 ? size - block : 4096);
+        }
+    }
+
+    state.size += size;
+
+    return;
+}
+#endif
+
+uint32_t checksum_crc32(const checksum_state &state)
+{
+    return ~state.crc;
+}
+
+uint32_t checksum_adler32(const checksum_state &state)
+{
+    return (state.adler_b << 16) | state.adler_a;
+}
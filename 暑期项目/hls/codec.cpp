@@ -0,0 +1,93 @@
+/*
+ * File:   codec.cpp
+ *
+ * Combined top level of the Deflate and Inflate cores.
+ */
+
+#include "deflate.h"
+
+/*
+ * Codec holds both cores behind one AXI-Lite 'control' bundle and one pair
+ * of streams, so one bitstream serves mixed compression and decompression
+ * traffic. The 'opcode' register selects the core per job:
+ *
+ * 1. OP_DEFLATE: 'size' input bytes are compressed in the 'format' container,
+ * as with Deflate(). Codec returns the compressed bytes; status is INFLATE_OK.
+ * 2. OP_INFLATE: the compressed job up to TLAST is decompressed, as with
+ * inflate(); 'size' is not used. Codec returns the decompressed bytes and
+ * status has the INFLATE_* errors.
+ *
+ * With any other opcode, the input is dropped up to TLAST, one empty word
+ * with TLAST is sent so the DMA receive completes, and status is
+ * CODEC_OPCODE_ERROR.
+ *
+ * The 'perf' registers hold the PERF_* counters of the core that ran the
+ * job; they are all zero after a dropped job.
+ *
+ * Only one core runs per job, so the streams are never shared at once.
+ */
+
+// Drop the input job up to TLAST and end the output job with an empty word
+static void codec_drop_job(hls::stream<axi_word> &input, hls::stream<axi_word> &output)
+{
+    axi_word drain_word;
+
+DRAIN_INPUT:
+    do
+    {
+#pragma HLS PIPELINE II = 1
+        input.read(drain_word);
+    } while (!drain_word.last);
+
+    output.write(make_axi_word(0, 0, true));
+
+    return;
+}
+
+// Top level module for compression and decompression
+unsigned Codec(hls::stream<axi_word> &input,
+               hls::stream<axi_word> &output,
+               unsigned opcode,
+               unsigned format,
+               unsigned size,
+               unsigned &status,
+               unsigned perf[PERF_NUM])
+{
+#pragma HLS INTERFACE ap_ctrl_chain port=return bundle=control
+#pragma HLS INTERFACE s_axilite port=return bundle=control
+#pragma HLS INTERFACE axis register both port=output
+#pragma HLS INTERFACE axis register both port=input
+#pragma HLS INTERFACE s_axilite port=opcode bundle=control
+#pragma HLS INTERFACE s_axilite port=format bundle=control
+#pragma HLS INTERFACE s_axilite port=size bundle=control
+#pragma HLS INTERFACE s_axilite port=status bundle=control
+#pragma HLS INTERFACE s_axilite port=perf bundle=control
+
+    unsigned output_size = 0;
+    unsigned job_status = INFLATE_OK;
+
+    if (opcode == OP_DEFLATE)
+    {
+        output_size = Deflate(input, output, format, size, perf);
+    }
+    else if (opcode == OP_INFLATE)
+    {
+        inflate(input, output, format, job_status, output_size, perf);
+    }
+    else
+    {
+        codec_drop_job(input, output);
+        job_status = CODEC_OPCODE_ERROR;
+
+    CLEAR_PERF:
+        for (int i = 0; i < PERF_NUM; i++)
+        {
+#pragma HLS UNROLL
+            perf[i] = 0;
+        }
+    }
+
+    status = job_status;
+
+    return output_size;
+}
@@ -0,0 +1,176 @@
+/*
+ * File:   codec_test.cpp
+ *
+ * Test bench of the combined top level Codec.
+ */
+
+#include "stream_io.h"
+
+/*
+ * Mixed traffic through one Codec: each message is compressed, then the
+ * compressed job is decompressed, alternating opcodes and containers. A job
+ * with an unknown opcode must be dropped without disturbing the next one,
+ * and a match with the distance code 30, an over-subscribed code, a stored
+ * block with a wrong NLEN or cut short, or a trailer cut short must end its
+ * job with a data error.
+ * The byte counters of each job must match the sizes on both sides. A job
+ * of 3 * STREAM_BYTES + 1 bytes must come back through both cores with the
+ * bytes of each partial last word in the low lanes, TKEEP = (1 << bytes) - 1.
+ */
+
+#define NUM_MESSAGES 6
+
+// Receive a job of 'size' bytes straight from the byte lanes: the first byte
+// of a word is in the top valid lane. False unless every word has the TKEEP
+// of its bytes and only the last word, with TLAST, is partial.
+static bool receive_lanes(hls::stream<axi_word> &output, unsigned size, string &data)
+{
+    unsigned words = size == 0 ? 1 : (size + STREAM_BYTES - 1) / STREAM_BYTES;
+    axi_word word;
+    bool ok = true;
+
+    data.clear();
+    for (unsigned i = 0; i < words && ok; i++)
+    {
+        unsigned valid_bytes = size - i * STREAM_BYTES < STREAM_BYTES ? size - i * STREAM_BYTES : STREAM_BYTES;
+        output.read(word);
+        ok = (unsigned)word.keep == (1u << valid_bytes) - 1 && word.last == (i == words - 1);
+        for (unsigned k = 0; k < valid_bytes; k++)
+            data.push_back((char)(uint8_t)(word.data >> (8 * (valid_bytes - 1 - k))));
+    }
+
+    return ok;
+}
+
+int main(void)
+{
+    string text =
+        "Our prefetcher is most easily incorporated into libraries that implement graph traversal for CSR graphs. To this "
+        "end, we use the Boost Graph Library (BGL) [41], a C++ templated library supporting many graph-based algorithms "
+        "and graph data structures. To support our prefetcher, we added configuration instructions on constructors for CSR "
+        "data structures, circular buffer queues (serving as the work list) and colour vectors (serving as the visited list).";
+
+    hls::stream<axi_word> input, output;
+    unsigned status;
+    unsigned deflate_perf[PERF_NUM], inflate_perf[PERF_NUM];
+    bool isFail = false;
+
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+
+    for (int m = 0; m < NUM_MESSAGES; m++)
+    {
+        string message = text.substr(m * 37, 60 + m * 50);
+        unsigned format = m % 3;
+
+        // compress
+        send_job(input, message);
+        unsigned compressed_size = Codec(input, output, OP_DEFLATE, format, message.size(), status, deflate_perf);
+        string compressed = receive_job(output);
+
+        // decompress
+        send_job(input, compressed);
+        unsigned decompressed_size = Codec(input, output, OP_INFLATE, format, 0, status, inflate_perf);
+        string decompressed = receive_job(output);
+
+        cout << "message " << m << ": " << message.size() << " -> " << compressed_size << " bytes" << endl;
+        if (compressed.size() != compressed_size || status != INFLATE_OK ||
+            decompressed_size != message.size() || decompressed != message)
+        {
+            isFail = true;
+            cout << "Codec Fail! Message " << m << ", status " << status << endl;
+        }
+        if (deflate_perf[PERF_BYTES_IN] != message.size() || deflate_perf[PERF_BYTES_OUT] != compressed_size ||
+            inflate_perf[PERF_BYTES_IN] != compressed_size || inflate_perf[PERF_BYTES_OUT] != decompressed_size ||
+            inflate_perf[PERF_LITERALS] + inflate_perf[PERF_MATCHES] != deflate_perf[PERF_LITERALS] + deflate_perf[PERF_MATCHES])
+        {
+            isFail = true;
+            cout << "Codec Fail! Counters of message " << m << endl;
+        }
+    }
+
+    // an unknown opcode drops the job
+    send_job(input, text);
+    unsigned dropped_size = Codec(input, output, 7, FORMAT_RAW, text.size(), status, deflate_perf);
+    string dropped = receive_job(output);
+    if (dropped_size != 0 || dropped.size() != 0 || status != CODEC_OPCODE_ERROR || !input.empty() ||
+        deflate_perf[PERF_BYTES_IN] != 0)
+    {
+        isFail = true;
+        cout << "Codec Fail! Unknown opcode." << endl;
+    }
+
+    // partial last words on both sides
+    string odd = text.substr(5, 3 * STREAM_BYTES + 1), odd_compressed, odd_decompressed;
+    send_job(input, odd);
+    unsigned odd_compressed_size = Codec(input, output, OP_DEFLATE, FORMAT_GZIP, odd.size(), status, deflate_perf);
+    bool lanes_ok = receive_lanes(output, odd_compressed_size, odd_compressed);
+    send_job(input, odd_compressed);
+    unsigned odd_size = Codec(input, output, OP_INFLATE, FORMAT_GZIP, 0, status, inflate_perf);
+    lanes_ok &= odd_size == odd.size() && receive_lanes(output, odd_size, odd_decompressed);
+    if (!lanes_ok || status != INFLATE_OK || odd_decompressed != odd)
+    {
+        isFail = true;
+        cout << "Codec Fail! TKEEP of a partial last word, status " << status << endl;
+    }
+
+    // a static block of 'a' and a match of length 3 with distance code 30
+    send_job(input, string("\x4B\x04\x3E\x00", 4));
+    Codec(input, output, OP_INFLATE, FORMAT_RAW, 0, status, inflate_perf);
+    receive_job(output);
+    if (!(status & INFLATE_DATA_ERROR) || !input.empty())
+    {
+        isFail = true;
+        cout << "Codec Fail! Distance code 30, status " << status << endl;
+    }
+
+    // zlib and gzip jobs cut 2 bytes into the trailer
+    for (unsigned format = FORMAT_ZLIB; format <= FORMAT_GZIP; format++)
+    {
+        send_job(input, text);
+        Codec(input, output, OP_DEFLATE, format, text.size(), status, deflate_perf);
+        string cut = receive_job(output);
+        cut.resize(cut.size() - (format == FORMAT_ZLIB ? 4 : 8) + 2);
+        send_job(input, cut);
+        Codec(input, output, OP_INFLATE, format, 0, status, inflate_perf);
+        receive_job(output);
+        if (status != INFLATE_DATA_ERROR || !input.empty())
+        {
+            isFail = true;
+            cout << "Codec Fail! Trailer cut short, format " << format << ", status " << status << endl;
+        }
+    }
+
+    // a stored block of 5 bytes with a wrong NLEN, then one cut after 2 bytes
+    const string stored_blocks[2] = {string("\x01\x05\x00\xFB\xFFhello", 10), string("\x01\x05\x00\xFA\xFFhe", 7)};
+    for (int i = 0; i < 2; i++)
+    {
+        send_job(input, stored_blocks[i]);
+        unsigned stored_size = Codec(input, output, OP_INFLATE, FORMAT_RAW, 0, status, inflate_perf);
+        receive_job(output);
+        if (!(status & INFLATE_DATA_ERROR) || stored_size > 2 || !input.empty())
+        {
+            isFail = true;
+            cout << "Codec Fail! Stored block " << i << ", status " << status << endl;
+        }
+    }
+
+    // a dynamic block with 257 literal/length codes of 8 bits, one too many,
+    // then the code of the end of block that overlaps literal 0
+    send_job(input, string("\x05\xC0\x05\x20\x00\x00\x00\x00\x20\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+                           "\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x17\x00", 32));
+    Codec(input, output, OP_INFLATE, FORMAT_RAW, 0, status, inflate_perf);
+    receive_job(output);
+    if (!(status & INFLATE_DATA_ERROR) || !input.empty())
+    {
+        isFail = true;
+        cout << "Codec Fail! Over-subscribed code, status " << status << endl;
+    }
+
+    if (!isFail)
+    {
+        cout << "Codec Succeed!" << endl;
+    }
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+
+    return isFail ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+/*
+ * File:   cycle_model.cpp
+ *
+ * Cycle-approximate throughput model of both cores, C simulation only.
+ */
+
+#include "deflate.h"
+#include <iomanip>
+
+/*
+ * The main loops count their iterations in C simulation (MODEL_ITERATION).
+ * Each iteration costs the cycles of its loop in the table below: the
+ * declared II of a pipelined loop, or the latency of one iteration of a loop
+ * that is not pipelined. The loops of a stage run one after the other, so
+ * the cycles of a stage are the sum over its loops.
+ *
+ * A Deflate job runs LZ77, then the Huffman encoder. An inflate job runs
+ * stream_unpack, the Huffman decoder and the main loop of LZ77_decoder
+ * concurrently (DATAFLOW), so the slowest of them sets the pace; the output
+ * loop of LZ77_decoder follows once all tokens are in. This gives the cycles
+ * of a job:
+ *
+ *     LZ77 + HUFFMAN + max(UNPACK, DECODER, LZ77_DECODER) + OUTPUT
+ *
+ * Pipeline depths and the start of each job are not counted, and the
+ * streams never stall, so the model is an upper bound of the throughput.
+ * The costs are from the pragmas; where the synthesis report shows another
+ * II or latency, change the table and run the model again.
+ */
+
+#ifndef __SYNTHESIS__
+
+#define MODEL_STAGE_LZ77 0
+#define MODEL_STAGE_HUFFMAN 1
+#define MODEL_STAGE_UNPACK 2
+#define MODEL_STAGE_DECODER 3
+#define MODEL_STAGE_LZ77_DECODER 4
+#define MODEL_STAGE_OUTPUT 5
+#define MODEL_STAGES 6
+
+// CONTROL_LOOP is not pipelined: dictionary read, VEC x LEN compares, match
+// choice and dictionary update in one iteration. Assumed latency.
+#define MODEL_CONTROL_LATENCY 8
+
+// The Huffman tables of a dynamic block: clearing the code lengths (8 per
+// cycle), the pipelined loops of get_huffman_table_1/2/3, and the lookup
+// tables written two entries per cycle. The lookup tables of an incomplete
+// code are cleared first, which is not counted.
+#define MODEL_TABLES_LATENCY (286 / 8 + 30 / 8 + (15 + 286) + (15 + 30) + (19 + 7 + 19) + (512 + 64 + 128) / 2)
+
+struct model_loop
+{
+    const char *name;
+    unsigned cycles; // per iteration
+    unsigned stage;
+};
+
+static const model_loop MODEL_LOOP_TABLE[MODEL_LOOPS] = {
+    {"CONTROL_LOOP", MODEL_CONTROL_LATENCY, MODEL_STAGE_LZ77},
+    {"FILL_LOOP_*", 1, MODEL_STAGE_LZ77},
+    {"DRAIN_INPUT (LZ77)", 1, MODEL_STAGE_LZ77},
+    {"STATIC_HUFFMAN", 1, MODEL_STAGE_HUFFMAN},
+    {"UNPACK_LOOP", 1, MODEL_STAGE_UNPACK},
+    {"GET_CCL", 1, MODEL_STAGE_DECODER},
+    {"DECODE_CL", 1, MODEL_STAGE_DECODER},
+    {"Huffman tables", MODEL_TABLES_LATENCY, MODEL_STAGE_DECODER},
+    {"STORED_COPY", 1, MODEL_STAGE_DECODER},
+    {"DECODE_MAIN_LOOP", 1, MODEL_STAGE_DECODER},
+    {"LZ77_MAIN_LOOP", 1, MODEL_STAGE_LZ77_DECODER},
+    {"COPY_MATCHED_CHAR", 1, MODEL_STAGE_LZ77_DECODER},
+    {"LZ77_OUTPUT", 1, MODEL_STAGE_OUTPUT},
+};
+
+uint64_t model_iterations[MODEL_LOOPS]; // iterations of the current job
+
+static uint64_t total_iterations[MODEL_LOOPS]; // iterations of all jobs since the last reset
+static uint64_t total_cycles;                  // cycles of all jobs since the last reset
+static uint64_t total_jobs;
+
+void model_end_job()
+{
+    uint64_t stage_cycles[MODEL_STAGES] = {0};
+
+    for (int i = 0; i < MODEL_LOOPS; i++)
+    {
+        stage_cycles[MODEL_LOOP_TABLE[i].stage] += model_iterations[i] * MODEL_LOOP_TABLE[i].cycles;
+        total_iterations[i] += model_iterations[i];
+        model_iterations[i] = 0;
+    }
+
+    uint64_t dataflow_cycles = stage_cycles[MODEL_STAGE_UNPACK];
+    if (stage_cycles[MODEL_STAGE_DECODER] > dataflow_cycles)
+        dataflow_cycles = stage_cycles[MODEL_STAGE_DECODER];
+    if (stage_cycles[MODEL_STAGE_LZ77_DECODER] > dataflow_cycles)
+        dataflow_cycles = stage_cycles[MODEL_STAGE_LZ77_DECODER];
+
+    total_cycles += stage_cycles[MODEL_STAGE_LZ77] + stage_cycles[MODEL_STAGE_HUFFMAN] + dataflow_cycles +
+                    stage_cycles[MODEL_STAGE_OUTPUT];
+    total_jobs++;
+}
+
+// Predicted cycles of all jobs since the last reset
+uint64_t model_cycles()
+{
+    return total_cycles;
+}
+
+// Print the loops run since the last reset and the predicted throughput for 'bytes' uncompressed bytes
+uint64_t model_report(const char *title, uint64_t bytes)
+{
+    uint64_t cycles = total_cycles;
+
+    cout << title << ": " << total_jobs << " jobs, " << bytes << " bytes" << endl;
+    if (!MODEL_ENABLED)
+    {
+        // nothing was counted, so there is no prediction to print
+        cout << "    no cycle model in the native build" << endl;
+        model_reset();
+        return 0;
+    }
+    cout << "    " << left << setw(20) << "loop" << right << setw(12) << "iterations" << setw(8) << "cycles"
+         << setw(12) << "total" << endl;
+    for (int i = 0; i < MODEL_LOOPS; i++)
+    {
+        if (total_iterations[i] == 0)
+            continue;
+        cout << "    " << left << setw(20) << MODEL_LOOP_TABLE[i].name << right << setw(12) << total_iterations[i]
+             << setw(8) << MODEL_LOOP_TABLE[i].cycles << setw(12) << total_iterations[i] * MODEL_LOOP_TABLE[i].cycles
+             << endl;
+    }
+
+    double bytes_per_cycle = cycles == 0 ? 0 : (double)bytes / cycles;
+    streamsize precision = cout.precision(3);
+    cout << "    predicted " << cycles << " cycles, " << bytes_per_cycle << " bytes/cycle, "
+         << bytes_per_cycle * MODEL_CLOCK_MHZ << " MB/s at " << MODEL_CLOCK_MHZ << " MHz" << endl;
+    cout.precision(precision);
+
+    model_reset();
+
+    return cycles;
+}
+
+void model_reset()
+{
+    for (int i = 0; i < MODEL_LOOPS; i++)
+    {
+        model_iterations[i] = 0;
+        total_iterations[i] = 0;
+    }
+    total_cycles = 0;
+    total_jobs = 0;
+}
+
+#endif
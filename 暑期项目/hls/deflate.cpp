@@ -18,64 +18,249 @@
  *
  * 1. Currently, the core only supports max offset = 4096 and max length = 32(LEN) for LZ77
  * It's a tradeoff between compression ratio and speed.
- * 2. Please note that the static Huffman encoding uses Little-Endian now.
+ * 2. Please note that the static Huffman encoding uses the bit order of the standard now.
  * 3. The dynamic encoding part is commented out. Because building dynamic Huffman trees can be
  * implemented using hardware or host CPU + PCIe. The commented code is the major part of
  * hardware implementation.
  */
 
 /*
- * Endianness Clarification:
+ * Bit Order Clarification:
  *
- * Endianness is quite confusing in the standard and in the project.
- * It's necessary to state the endianness details in the cores.
+ * Both cores follow the bit order of the standard natively (rfc1951 3.1.1).
  *
- * Compression:
- * 1. LZ77 core: no endianness issue.
+ * 1. Bits are packed into each byte starting at the LSB; the first byte of
+ * a stream word is in bits 31-24, so byte_swap() turns a word into the
+ * LSB-first bit order and back. This is wiring, no logic.
+ * 2. Header bits, extra bits, HLIT/HDIST/HCLEN and CCL are written and read
+ * LSB-first as they are.
+ * 3. Huffman codes are defined MSB-first. The fixed code tables are stored
+ * pre-reversed, and the decoder lookup tables are indexed by the next bits
+ * of the stream, LSB-first. Bits are only reversed off the critical path,
+ * when the lookup tables of a dynamic block are built.
  *
- * 2. Static Huffman Encoding Part:
- * 		header bits: little-endian (correct)
- * 		huffman codes: big-endian (correct)
- * 		extra bits: big-endian (wrong, should change to little-endian if following standard)
- * 		write to output stream: little-endian (correct)
- * 3. Dynamic Huffman Encoding Part:
- * 		All big-endian; extra bits should be little-endian
+ * Therefore, no bit reversal is done per symbol or per word, and the output
+ * of the Deflate core is a conformant raw DEFLATE stream.
+ */
+
+/*
+ * Control Interface:
+ *
+ * The core is started per job through the AXI-Lite 'control' bundle
+ * (ap_ctrl_chain). 'size' is the number of input bytes of the job, and the
+ * core returns the number of compressed bytes. A job must not exceed
+ * MAX_JOB_SIZE bytes.
+ *
+ * The stream width is STREAM_WIDTH bits (32, 64 or 128), the first byte in
+ * the top bits of a word. LZ77 unpacks the words into its VEC lanes, one word
+ * every STREAM_BYTES / VEC iterations, or VEC / STREAM_BYTES words per
+ * iteration. The encoder packs its 32-bit output lanes into stream words.
+ *
+ * Both streams use the AXI-Stream side channels. The input job ends at the
+ * word with TLAST, or after 'size' bytes, whichever comes first; words after
+ * 'size' bytes are read up to TLAST and dropped. The last output word has
+ * TLAST set, and TKEEP marks its valid bytes, so a DMA receive completes on
+ * the compressed size.
+ *
+ * Performance Counters:
+ *
+ * The 'perf' register array holds the counters of the last job (PERF_*):
+ * bytes in and out, the iterations of the LZ77 and Huffman loops, the input
+ * words that were not ready and the output words that could not be written
+ * at once, and the number of matches and literals. The same counters are
+ * filled in C simulation, where the streams never stall.
+ *
+ * Container Format:
+ *
+ * The 'format' register selects a raw DEFLATE stream, a zlib stream or a
+ * gzip member (FORMAT_RAW/ZLIB/GZIP). The checksums are computed inline by
+ * LZ77 as it reads the input words, so the trailer costs no extra pass.
+ * The header is written before the block, and the trailer is written at the
+ * next byte boundary after the end-of-block code.
+ *
+ * Sync Flush:
+ *
+ * With FORMAT_SYNC_FLUSH set in 'format', the block is not the last one
+ * (BFINAL = 0), and the job ends with an empty stored block instead of the
+ * trailer, like zlib's Z_SYNC_FLUSH. The output then ends on a byte boundary
+ * and can be followed by the output of the next job. No match reaches back
+ * into an earlier job, so the jobs of one stream can be compressed in any
+ * order and on several cores (see parallel.cpp). The header of zlib and gzip
+ * is still written; the host ends the stream with the last block and the
+ * trailer.
  *
- * Decompression:
- * 1. Static Huffman Decoding Part:
- * 		header bits: little-endian (correct)
- * 		read from input stream: little-endian (correct)
- * 		huffman codes: big-endian (correct)
- * 		extra bits: big-endian (wrong, should be little-endian)
- * 2. Dynamic Huffman Decoding Part:
- * 		header bits: little-endian (correct)
- * 		read from input stream: little-endian (correct)
- * 		huffman codes: big-endian (correct)
- * 		all other extra bits, HLIT codes, etc. : little-endian (correct)
+ * Continued Streams:
  *
- * In summary, the extra bits endianness in static Huffman encoding/decoding is wrong.
- * Other parts are correct. The Deflate and Inflate core matches each other.
+ * With FORMAT_CONTINUE also set, the job goes on with the stream of the last
+ * job on the core, for streams of small messages that must each be sent at
+ * once (RPC payloads, log lines): each message is a job with the sync flush,
+ * and its output is complete on a byte boundary when the job ends. The
+ * header is not written again, the checksums go on from the last job, and
+ * the matches reach up to LZ77_HISTORY bytes back into the earlier jobs of
+ * the stream, so a message that repeats an earlier one costs a few bytes.
+ * A job without FORMAT_CONTINUE starts a stream. The last job of a stream,
+ * without the sync flush, ends it with the last block and the trailer; it
+ * can be empty. The jobs of such a stream must run in order on one core,
+ * with no other compression job in between.
+ *
+ * Framed Jobs:
+ *
+ * With FORMAT_FRAMED set, the job is a batch of small messages (frames), so
+ * that the DMA setup and the start of the core are paid once per batch. Each
+ * frame is a prefix word, the length of the message in its top 32 bits,
+ * then the message, padded to a word; 'size' is the bytes of the whole
+ * batch. Each frame is compressed as a stream of its own in the container of
+ * 'format', with no match into an earlier frame, and its output is padded to
+ * a word. After the last frame comes the size table, 32 bits per entry,
+ * first byte at the top: the compressed bytes of each frame, then the number
+ * of frames. The core returns the bytes of all of it, padding included.
+ *
+ * A batch has at most MAX_FRAMES frames of up to MAX_JOB_SIZE bytes; the
+ * input from a longer frame or after MAX_FRAMES frames is dropped up to
+ * TLAST. The LZ77 buffer is still filled again for each frame.
  */
 
+// Add the counters of a frame to those of the job
+static void perf_add(perf_counters &total, const perf_counters &frame)
+{
+    total.bytes_in += frame.bytes_in;
+    total.bytes_out += frame.bytes_out;
+    total.lz77_cycles += frame.lz77_cycles;
+    total.huffman_cycles += frame.huffman_cycles;
+    total.input_stalls += frame.input_stalls;
+    total.output_stalls += frame.output_stalls;
+    total.matches += frame.matches;
+    total.literals += frame.literals;
+}
+
+// Compress the frames of a framed job one by one, then write the size table;
+// returns the bytes written
+static unsigned deflate_frames(hls::stream<axi_word> &input, hls::stream<axi_word> &output, unsigned format,
+                               unsigned size, uint8_t LZ77_output[LZ77_BUFFER_SIZE], perf_counters &counters)
+{
+    uint32_t frame_sizes[MAX_FRAMES];
+#pragma HLS ARRAY_PARTITION variable = frame_sizes cyclic factor = 4 dim = 1
+    perf_counters frame_counters;
+    checksum_state checksum;
+    axi_word prefix;
+    unsigned input_words = (size + STREAM_BYTES - 1) / STREAM_BYTES;
+    unsigned words_read = 0, frames = 0, output_words = 0;
+    bool done_input = false;
+
+    counters.bytes_in = counters.bytes_out = counters.lz77_cycles = counters.huffman_cycles = 0;
+    counters.input_stalls = counters.output_stalls = counters.matches = counters.literals = 0;
+
+FRAME_LOOP:
+    while (!done_input && words_read < input_words && frames < MAX_FRAMES)
+    {
+#pragma HLS loop_tripcount min = 1 max = 256
+        input.read(prefix);
+        words_read++;
+        unsigned frame_size = (uint32_t)(stream_data(prefix) >> (STREAM_WIDTH - 32));
+        done_input = prefix.last;
+        if (frame_size > MAX_JOB_SIZE || (done_input && frame_size != 0))
+            break; // a frame too long, or a prefix without its message
+
+        // an empty frame reads nothing, its prefix may be the last word
+        int LZ77_output_size = LZ77(input, frame_size, LZ77_output, checksum, frame_counters, done_input, false, false,
+                                    format & FORMAT_CONTAINER);
+        done_input |= prefix.last;
+        words_read += (frame_size + STREAM_BYTES - 1) / STREAM_BYTES;
+
+        frame_sizes[frames] = huffman(LZ77_output, LZ77_output_size, output, format & ~(FORMAT_FRAMED | FORMAT_CONTINUE),
+                                      checksum, frame_counters, false);
+        output_words += (frame_sizes[frames] + STREAM_BYTES - 1) / STREAM_BYTES;
+        perf_add(counters, frame_counters);
+        frames++;
+    }
+
+    // drop the rest of the job, up to TLAST
+DRAIN_FRAMES:
+    while (!done_input)
+    {
+#pragma HLS PIPELINE II = 1
+        input.read(prefix);
+        done_input = prefix.last;
+        counters.lz77_cycles++;
+        MODEL_ITERATION(MODEL_LZ77_DRAIN);
+    }
+
+    // the size table, then the number of frames, with TLAST on its last word
+    unsigned table_bytes = (frames + 1) * 4;
+    unsigned table_words = (table_bytes + STREAM_BYTES - 1) / STREAM_BYTES;
+
+SIZE_TABLE:
+    for (unsigned w = 0; w < table_words; w++)
+    {
+#pragma HLS PIPELINE II = 1
+#pragma HLS loop_tripcount min = 1 max = 257
+        stream_data_t word = 0;
+    PACK_SIZES:
+        for (int l = 0; l < STREAM_WIDTH / 32; l++)
+        {
+#pragma HLS UNROLL
+            unsigned entry = w * (STREAM_WIDTH / 32) + l;
+            uint32_t value = entry < frames ? frame_sizes[entry] : entry == frames ? frames : 0;
+            word |= (stream_data_t)value << (STREAM_WIDTH - 32 * (l + 1));
+        }
+        unsigned valid_bytes = table_bytes - w * STREAM_BYTES;
+        output.write(make_axi_word(word, valid_bytes < STREAM_BYTES ? valid_bytes : STREAM_BYTES, w == table_words - 1));
+    }
+
+    counters.bytes_in = size;
+    counters.bytes_out = output_words * STREAM_BYTES + table_bytes;
+
+    return counters.bytes_out;
+}
+
 // Top level module for compression
-void Deflate(hls::stream<uint32_t> &input,
-             hls::stream<uint32_t> &output)
+unsigned Deflate(hls::stream<axi_word> &input,
+                 hls::stream<axi_word> &output,
+                 unsigned format,
+                 unsigned size,
+                 unsigned perf[PERF_NUM])
 {
-#pragma HLS INTERFACE ap_ctrl_none register port=return
+#pragma HLS INTERFACE ap_ctrl_chain port=return bundle=control
+#pragma HLS INTERFACE s_axilite port=return bundle=control
 #pragma HLS INTERFACE axis register both port=output
 #pragma HLS INTERFACE axis register both port=input
+#pragma HLS INTERFACE s_axilite port=format bundle=control
+#pragma HLS INTERFACE s_axilite port=size bundle=control
+#pragma HLS INTERFACE s_axilite port=perf bundle=control
 
     // temp array for connecting two cores
-    uint8_t LZ77_output[3000];
+    uint8_t LZ77_output[LZ77_BUFFER_SIZE];
+    int LZ77_output_size;
+
+    // checksums of the uncompressed data, kept for the next job of a continued stream
+    CORE_STATE checksum_state checksum;
+
+    perf_counters counters;
+    unsigned compressed_size;
+    bool done_input;
 
-    LZ77(input, 2250, LZ77_output);
+    if (size > MAX_JOB_SIZE && !(format & FORMAT_FRAMED))
+        size = MAX_JOB_SIZE; // keep the buffers safe, the host splits larger data
+
+    if (format & FORMAT_FRAMED)
+    {
+        compressed_size = deflate_frames(input, output, format, size, LZ77_output, counters);
+        perf_export(counters, perf);
+        return compressed_size;
+    }
+
+    LZ77_output_size = LZ77(input, size, LZ77_output, checksum, counters, done_input, true, format & FORMAT_CONTINUE,
+                            format & FORMAT_CONTAINER);
 
     //    // Print out the compressed data - for testing
     //    int offset, length;
     //    int j = 0;
     //    cout << endl << "LZ77 compressed stream is:" << endl << endl;
-    //    while (LZ77_output[j] != '\0') {
-    //        if (LZ77_output[j] == '@') {
+    //    while (j < LZ77_output_size) {
+    //        if (LZ77_output[j] == '@' && LZ77_output[j + 1] == LZ77_LITERAL_AT) {
+    //            cout << '@';
+    //            j += 2;
+    //        } else if (LZ77_output[j] == '@') {
     //            offset = (LZ77_output[j + 1] * 128) + LZ77_output[j + 2];
     //            length = LZ77_output[j + 3];
     //            cout << "@(" << offset << "," << length << ")";
@@ -88,10 +273,269 @@ void Deflate(hls::stream<uint32_t> &input,
     //
     //    cout << endl << endl;
 
-    huffman(LZ77_output, output);
+    compressed_size = huffman(LZ77_output, LZ77_output_size, output, format, checksum, counters, true);
+
+    perf_export(counters, perf);
+
+    return compressed_size;
+}
+
+void perf_export(const perf_counters &counters, unsigned perf[PERF_NUM])
+{
+    perf[PERF_BYTES_IN] = counters.bytes_in;
+    perf[PERF_BYTES_OUT] = counters.bytes_out;
+    perf[PERF_LZ77_CYCLES] = counters.lz77_cycles;
+    perf[PERF_HUFFMAN_CYCLES] = counters.huffman_cycles;
+    perf[PERF_INPUT_STALLS] = counters.input_stalls;
+    perf[PERF_OUTPUT_STALLS] = counters.output_stalls;
+    perf[PERF_MATCHES] = counters.matches;
+    perf[PERF_LITERALS] = counters.literals;
+
+    return;
+}
+
+// Write a literal to the LZ77 output; a literal '@' is escaped
+static void LZ77_write_literal(uint8_t output[LZ77_BUFFER_SIZE], int &output_position, uint8_t literal)
+{
+#pragma HLS INLINE
+    MODEL_ITERATION(MODEL_FILL_LOOP); // called once per iteration of the FILL_LOOP_* loops
+    output[output_position++] = literal;
+    if (literal == '@')
+        output[output_position++] = LZ77_LITERAL_AT;
+}
+
+// Read the next word of the job into input_data; the job ends early at the
+// word with TLAST
+static CORE_INLINE void LZ77_read_word(hls::stream<axi_word> &input, stream_data_t &input_data, int &words_read,
+                           bool &done_input, int &size, perf_counters &perf)
+{
+#pragma HLS INLINE
+    axi_word input_axi_word;
+
+    if (input.empty())
+        perf.input_stalls++; // the read below waits for the input
+    input.read(input_axi_word); // read one word from the input stream
+    input_data = stream_data(input_axi_word);
+    words_read++;
+    if (input_axi_word.last)
+    {
+        // the job ends with this word
+        done_input = true;
+        size = size < words_read * STREAM_BYTES ? size : words_read * STREAM_BYTES;
+    }
+
+    return;
+}
+
+#ifndef DEFLATE_NATIVE
+// Unpack the next VEC bytes of the job into curr_window[pos .. pos + VEC - 1].
+// A new stream word is read once the lanes of the last one are used up; bytes
+// after the end of the job are zeros.
+static void LZ77_load_bytes(hls::stream<axi_word> &input, uint8_t curr_window[VEC + LEN], int pos,
+                            stream_data_t &input_data, int &input_lane, int &words_read, int input_words,
+                            bool &done_input, int &size, checksum_state &checksum, perf_counters &perf)
+{
+#pragma HLS INLINE
+LOAD_WORDS:
+    for (int w = 0; w < (VEC > STREAM_BYTES ? VEC / STREAM_BYTES : 1); w++)
+    {
+#pragma HLS UNROLL
+        if (input_lane == 0)
+        {
+            input_data = 0;
+            if (words_read < input_words && !done_input)
+            {
+                LZ77_read_word(input, input_data, words_read, done_input, size, perf);
+                int valid_bytes = size - (words_read - 1) * STREAM_BYTES;
+                checksum_update(checksum, input_data, valid_bytes >= STREAM_BYTES ? STREAM_BYTES : valid_bytes);
+            }
+        }
+
+    LOAD_LANES:
+        for (int i = 0; i < (VEC > STREAM_BYTES ? STREAM_BYTES : VEC); i++)
+        {
+#pragma HLS UNROLL
+            curr_window[pos + w * STREAM_BYTES + i] = stream_byte(input_data, input_lane + i);
+        }
+
+        input_lane = (input_lane + VEC) % STREAM_BYTES;
+    }
 
     return;
 }
+#endif
+
+#ifdef DEFLATE_NATIVE
+// Whether any of the 4 bytes in 'bytes' is '@' (the bytes equal to '@' are zero after the XOR)
+static inline bool LZ77_has_at(uint32_t bytes)
+{
+    uint32_t x = bytes ^ 0x40404040;
+    return ((x - 0x01010101) & ~x & 0x80808080) != 0;
+}
+
+// The number of the 8 bytes in 'bytes' before the first '@' or byte of 0x80 and above (the
+// first byte is the low byte; the bytes equal to '@' are zero after the XOR)
+static inline int LZ77_ascii_literals(uint64_t bytes)
+{
+    uint64_t x = bytes ^ 0x4040404040404040ull;
+    uint64_t stop = (bytes | ((x - 0x0101010101010101ull) & ~x)) & 0x8080808080808080ull;
+    return stop != 0 ? __builtin_ctzll(stop) >> 3 : 8;
+}
+
+/*
+ * The CONTROL_LOOP of the native build, for the whole job at once: the same
+ * lookups, lengths and choices, so the output is the same byte for byte.
+ *
+ * 1. The job is in 'job' (job[k] is byte k, the bytes of the earlier jobs of
+ * the stream before it), so the strings are compared in place instead of in
+ * copies (comp_window).
+ * 2. The NUM_DICT entries of a hash value are side by side in dict_entries,
+ * and each keeps the key of its string, so the 16 lookups of an iteration
+ * run on SIMD registers (native_dict_lookup()). The top 8 bits of the key
+ * are the bytes of the string in its job (dict_string_bytes of the HLS loops).
+ * The hash values and keys of all the positions are computed first.
+ * 3. The string of a lane and dictionary (compare_window_string_start_pos)
+ * keeps its key too. A length is only counted where the keys are equal:
+ * any other string is shorter than 3 bytes, is never chosen, and loses
+ * to the others in bestlength. Most iterations then have no string to
+ * compare, and write their literals at once.
+ *
+ * Returns current_index after the loop; first_valid_position is as left by
+ * its last iteration.
+ */
+static int LZ77_native_search(const uint8_t *job, int size, uint32_t dict_entries[HASH_TABLE_SIZE][2][NUM_DICT],
+                              uint32_t job_base, uint32_t history, uint8_t output[LZ77_BUFFER_SIZE],
+                              int &output_size, int &valid_position)
+{
+    static_assert(VEC == 4 && NUM_DICT == 4, "native_dict_lookup() takes 4 lanes of 4 dictionaries");
+    static const uint8_t no_string[LEN] = {0};
+    // copies, which the byte stores to output cannot alias
+    int output_position = output_size;
+    int first_valid_position = valid_position;
+    uint16_t hash_values[MAX_JOB_SIZE];
+    uint32_t string_keys[MAX_JOB_SIZE]; // the keys of the dictionary entries, with the bytes
+    // bit NUM_DICT * i + t is lane i and dictionary t; the positions are relative to the history before this job
+    uint32_t compare_window_string_start_pos[VEC * NUM_DICT];
+    uint32_t compare_window_string_key[VEC * NUM_DICT];
+    match_pair bestlength[VEC];
+    int current_index;
+
+    for (int k = 0; k < size; k++)
+    {
+        int bytes = size - k;
+
+        hash_values[k] = (job[k] << 3) ^ (job[k + 1] << 2) ^ (job[k + 2] << 1) ^ job[k + 3];
+        // the first 3 bytes, the shortest match: strings whose keys differ cannot be chosen
+        string_keys[k] = job[k] | job[k + 1] << 8 | job[k + 2] << 16 | (bytes < LEN ? bytes : LEN) << 24;
+    }
+
+    for (int n = 0; n < VEC * NUM_DICT; n++)
+    {
+        compare_window_string_start_pos[n] = history - 4096; // no string yet: zeros
+        compare_window_string_key[n] = 0;
+    }
+
+    for (current_index = 0; current_index + VEC <= size; current_index += VEC)
+    {
+        const uint8_t *curr_window = job + current_index;
+        unsigned candidates;
+
+        first_valid_position -= VEC;
+
+        // 1. Dictionary Lookup and Update
+        native_dict_lookup(dict_entries, &hash_values[current_index], job_base - history,
+                           current_index + history, job_base + current_index, &string_keys[current_index],
+                           compare_window_string_start_pos, compare_window_string_key, candidates);
+
+        // the lanes before first_valid_position are not chosen from
+        if (first_valid_position > 0)
+            candidates &= first_valid_position < VEC ? ~0u << (NUM_DICT * first_valid_position) : 0;
+
+        if (candidates != 0)
+        {
+            // 2. Match Search and Reduction, for the strings with equal keys
+            int match_length = 0;
+            int offset = 0;
+            int start_match_position = 0;
+            int temp_valid_position = first_valid_position;
+
+            for (int i = 0; i < VEC; i++)
+            {
+                bestlength[i].string_start_pos = 0;
+                bestlength[i].length = 0;
+            }
+            for (unsigned rest = candidates; rest != 0; rest &= rest - 1)
+            {
+                int n = __builtin_ctz(rest); // lane n / NUM_DICT, dictionary n % NUM_DICT, in order
+                int i = n / NUM_DICT;
+                // a string of an earlier job is cut at its end
+                uint32_t pos = compare_window_string_start_pos[n];
+                int bytes = pos < history ? compare_window_string_key[n] >> 24 : LEN;
+                int string_pos = (int)(pos - history);
+                int length = native_match_length(&curr_window[i], string_pos < -LZ77_HISTORY ? no_string : &job[string_pos], LEN);
+                if (length > bytes)
+                    length = bytes;
+                if (length > bestlength[i].length)
+                {
+                    bestlength[i].length = length;
+                    bestlength[i].string_start_pos = string_pos;
+                }
+            }
+
+            // 3. Match Filtering, as CHOOSE_MATCHING_STRING
+            for (int i = first_valid_position; i < VEC; i++)
+            {
+                int match_limit = size - (current_index + i);
+                int candidate_length = bestlength[i].length < match_limit ? bestlength[i].length : match_limit;
+
+                if (candidate_length >= 3 && i + candidate_length > temp_valid_position)
+                {
+                    temp_valid_position = i + candidate_length;
+                    match_length = candidate_length;
+                    start_match_position = i;
+                    offset = (current_index + i) - bestlength[i].string_start_pos;
+                }
+            }
+
+            // 4. Fill In the Output Array
+            if (match_length > 0 && offset < 4096)
+            {
+                while (first_valid_position < start_match_position)
+                {
+                    LZ77_write_literal(output, output_position, curr_window[first_valid_position]);
+                    first_valid_position++;
+                }
+                output[output_position] = '@';
+                output[output_position + 1] = offset >> 7;
+                output[output_position + 2] = (offset & 0x07F);
+                output[output_position + 3] = match_length;
+                output_position += 4;
+                first_valid_position = temp_valid_position;
+            }
+        }
+
+        // the literals up to the next iteration, all VEC at once without a '@'
+        uint32_t literals;
+        memcpy(&literals, curr_window, sizeof(literals));
+        if (first_valid_position == 0 && !LZ77_has_at(literals))
+        {
+            memcpy(&output[output_position], &literals, sizeof(literals));
+            output_position += VEC;
+            first_valid_position = VEC;
+        }
+        while (first_valid_position < VEC)
+        {
+            LZ77_write_literal(output, output_position, curr_window[first_valid_position]);
+            first_valid_position++;
+        }
+    }
+
+    output_size = output_position;
+    valid_position = first_valid_position;
+
+    return current_index;
+}
+#endif
 
 /*
  * The first part of DEFLATE Algorithm - LZ77
@@ -103,6 +547,8 @@ void Deflate(hls::stream<uint32_t> &input,
  * LZ77 searches max matching in the dictionaries stored before. If found
  * a matching, the algorithm makes a pair of @(offset, length) on the data stream.
  * The output of LZ77 is a data array containing the literals, offsets, and lengths.
+ * A literal '@' is written as '@', LZ77_LITERAL_AT; the second byte of a match
+ * (offset >> 7) is always below it. LZ77 returns the size of the output array.
  * Then, the output is further compressed in the Huffman function below.
  *
  * At first, LZ77 takes one word from the hls_stream input. Calculate its hash value
@@ -115,26 +561,129 @@ void Deflate(hls::stream<uint32_t> &input,
  * the program updates the dictionaries using the data in curr_window.
  * 
  * 
- * Also note that the function argument 'size' is not necessary if the outermost
- * loop checks whether the input stream is empty each time.
+ * The job ends after 'size' bytes or at the input word with TLAST. The end is
+ * known at least LEN bytes ahead, so no match runs past the last byte of the job.
+ *
+ * The dictionaries are kept across jobs instead of being cleared. Their
+ * positions are absolute in the stream of all jobs, counted from job_base,
+ * so the entries of earlier jobs are told apart without a clearing pass.
+ * Past LZ77_REBASE, the positions are moved back before the job, and the
+ * entries more than LZ77_HISTORY bytes back, which can no longer match,
+ * are cleared. This keeps them from wrapping around after 4 GiB.
+ * With 'keep_history' (FORMAT_CONTINUE), the entries of the earlier jobs of
+ * the stream, from stream_base on, are used up to LZ77_HISTORY bytes back.
+ * A string copied near the end of its job has padding after the job, so
+ * dict_string_bytes keeps how many of its bytes are of the job, and a match
+ * into an earlier job is cut there. The checksums go on from the last job.
+ *
+ * The checksums of the container are updated with each word read. The
+ * native build adds the whole job at once, and only to the checksum of
+ * 'container' (see checksum_update_bytes()).
+ * The input words are unpacked into the VEC lanes by LZ77_load_bytes().
+ * LZ77 fills the input counters of perf. done_input tells whether the word
+ * with TLAST was read; with 'drain' clear, the words after 'size' bytes are
+ * left in the input (a frame of a framed job, see deflate_frames()).
  */
 
-void LZ77(hls::stream<uint32_t> &input, int size, uint8_t output[3000])
+int LZ77(hls::stream<axi_word> &input, int size, uint8_t output[LZ77_BUFFER_SIZE], checksum_state &checksum,
+         perf_counters &perf, bool &done_input, bool drain, bool keep_history, unsigned container)
 {
 
     /*************************** Initialization *******************************/
-    int iteration_count = size / VEC;
+    int input_words = (size + STREAM_BYTES - 1) / STREAM_BYTES;
+    int words_read = 0;
+    done_input = false; // the word with TLAST was read
 
     // Use current_index to indicate the start index of each set of processing data
     int current_index = 0;
     int output_position = 0;
 
+#ifdef DEFLATE_NATIVE
+    // the positions, then the keys, of the entries of a hash value side by side, see LZ77_native_search()
+    CORE_STATE uint32_t dict_entries[HASH_TABLE_SIZE][2][NUM_DICT]; // the keys with the bytes of the string in its job
+#else
     uint8_t comp_window[NUM_DICT][VEC][LEN];
-    uint8_t dict[NUM_DICT][HASH_TABLE_SIZE][LEN];
+    static uint8_t dict[NUM_DICT][HASH_TABLE_SIZE][LEN];
 
     // Record the information of where the string starts - in order to calculate offset
-    int dict_string_start_pos[NUM_DICT][HASH_TABLE_SIZE];
+    // dict_string_start_pos is absolute (0: empty); compare_window_string_start_pos is relative to this job
+    CORE_STATE uint32_t dict_string_start_pos[NUM_DICT][HASH_TABLE_SIZE];
+    CORE_STATE uint8_t dict_string_bytes[NUM_DICT][HASH_TABLE_SIZE]; // bytes of the string in its job, up to LEN
+#endif
+    CORE_STATE uint32_t job_base = 1;    // absolute position of the first byte of this job
+    CORE_STATE uint32_t stream_base = 1; // absolute position of the first byte of the stream
+    int first_valid_position = VEC;
+
+    // the bytes of earlier jobs of the stream that matches may reach
+    if (!keep_history)
+        stream_base = job_base;
+    if (job_base > LZ77_REBASE)
+    {
+        // the job starts again LZ77_HISTORY + 1 bytes after position 1
+        uint32_t shift = job_base - (LZ77_HISTORY + 1);
+    REBASE_DICT:
+        for (int i = 0; i < HASH_TABLE_SIZE; i++)
+        {
+#pragma HLS PIPELINE II = 1
+            for (int t = 0; t < NUM_DICT; t++)
+            {
+#pragma HLS UNROLL
+#ifdef DEFLATE_NATIVE
+                uint32_t &pos = dict_entries[i][0][t];
+#else
+                uint32_t &pos = dict_string_start_pos[t][i];
+#endif
+                pos = pos > shift ? pos - shift : 0;
+            }
+        }
+        job_base -= shift;
+        stream_base = stream_base > shift ? stream_base - shift : 1;
+    }
+    uint32_t history = job_base - stream_base < LZ77_HISTORY ? job_base - stream_base : LZ77_HISTORY;
+
+    // For hls_stream input
+#ifdef DEFLATE_NATIVE
+    // The native build keeps the whole job, after the last LZ77_HISTORY bytes
+    // of the stream: curr_window slides over it instead of shifting, and the
+    // dictionary strings are read from it in place of the copies in
+    // comp_window (see LZ77_native_search()).
+    CORE_STATE uint8_t job_window[LZ77_HISTORY + VEC + MAX_JOB_SIZE + LEN];
+    uint8_t *curr_window = job_window + LZ77_HISTORY;
+#else
+    uint8_t curr_window[VEC + LEN]; // a processing buffer containing all information to use
+    int input_lane = 0;             // the next byte of input_data; 0: read a new word
+#endif
+    stream_data_t input_data = 0;   // the stream word being unpacked
+    axi_word input_axi_word;
+
+    if (!keep_history)
+        checksum_init(checksum);
+
+    perf.input_stalls = 0;
+    perf.lz77_cycles = LEN / VEC; // the first fill of the processing buffer
+
+#ifdef DEFLATE_NATIVE
+    // Read the whole job first: the same words as the loads of the
+    // CONTROL_LOOP, which reaches TLAST at least LEN bytes ahead. The bytes
+    // after the last word are zeros.
+    while (words_read < input_words && !done_input)
+    {
+        LZ77_read_word(input, input_data, words_read, done_input, size, perf);
+        for (int k = 0; k < STREAM_BYTES; k++)
+        {
+            curr_window[VEC + (words_read - 1) * STREAM_BYTES + k] = stream_byte(input_data, k);
+        }
+    }
+    memset(curr_window + VEC + words_read * STREAM_BYTES, 0, MAX_JOB_SIZE + LEN - words_read * STREAM_BYTES);
+    checksum_update_bytes(checksum, curr_window + VEC, size, container);
+
+    current_index = LZ77_native_search(curr_window + VEC, size, dict_entries, job_base,
+                                       history, output, output_position, first_valid_position);
+    perf.lz77_cycles += current_index / VEC;
+    curr_window += current_index;
+#else
     int compare_window_string_start_pos[NUM_DICT][VEC];
+    int compare_window_string_bytes[NUM_DICT][VEC]; // LEN, or the bytes of a string of an earlier job
     int hash_value, new_hash_value;
 
     bool done[VEC];
@@ -142,30 +691,39 @@ void LZ77(hls::stream<uint32_t> &input, int size, uint8_t output[3000])
     match_pair bestlength[VEC];
 
     int match_length;
-    int offset;
+    int offset = 0;
     int start_match_position = 0;
-    int first_valid_position = 4;
     int temp_valid_position = 0;
 
-    // For hls_stream input
-    uint8_t curr_window[VEC + LEN]; // a processing buffer containing all information to use
-    uint32_t input_word;
-
-    for (char i = 1; i < 9; i++)
-    {                           // first time to fill in the processing buffer
-        input.read(input_word); // read one word from the input stream
-        curr_window[i * 4] = (input_word & 0xFF000000) >> 24;
-        curr_window[i * 4 + 1] = (input_word & 0x00FF0000) >> 16;
-        curr_window[i * 4 + 2] = (input_word & 0x0000FF00) >> 8;
-        curr_window[i * 4 + 3] = (input_word & 0x000000FF);
+CLEAR_COMPARE_WINDOW:
+    for (int t = 0; t < NUM_DICT; t++)
+    {
+#pragma HLS UNROLL
+        for (int i = 0; i < VEC; i++)
+        {
+#pragma HLS UNROLL
+            compare_window_string_start_pos[t][i] = -4096; // no string yet, out of the window
+            compare_window_string_bytes[t][i] = LEN;
+            for (int k = 0; k < LEN; k++)
+            {
+#pragma HLS UNROLL
+                comp_window[t][i][k] = 0; // compared before the first match is found
+            }
+        }
+    }
+
+    for (int i = VEC; i < VEC + LEN; i += VEC)
+    { // first time to fill in the processing buffer
+        LZ77_load_bytes(input, curr_window, i, input_data, input_lane, words_read, input_words,
+                        done_input, size, checksum, perf);
     }
 
     /************************** Main Loop *************************************/
 
 CONTROL_LOOP:
-    for (int loop_count = 0; loop_count < iteration_count; loop_count++)
+    while (current_index + VEC <= size)
     {
-#pragma HLS loop_tripcount min = 635 max = 635
+#pragma HLS loop_tripcount min = 0 max = 1024
 
         // 1. Dictionary Lookup and Update
         // search each dictionary to find most similar sequence
@@ -179,14 +737,10 @@ CONTROL_LOOP:
         }
 
         // Load in new data
-        if (!input.empty())
-        {
-            input.read(input_word);
-            curr_window[LEN] = (input_word & 0xFF000000) >> 24;
-            curr_window[LEN + 1] = (input_word & 0x00FF0000) >> 16;
-            curr_window[LEN + 2] = (input_word & 0x0000FF00) >> 8;
-            curr_window[LEN + 3] = (input_word & 0x000000FF);
-        }
+        LZ77_load_bytes(input, curr_window, LEN, input_data, input_lane, words_read, input_words,
+                        done_input, size, checksum, perf);
+        perf.lz77_cycles++;
+        MODEL_ITERATION(MODEL_CONTROL_LOOP);
 
         first_valid_position -= VEC; // minus VEC since the buffer will be shifted to left
 
@@ -207,9 +761,13 @@ CONTROL_LOOP:
 #pragma HLS UNROLL
 #pragma HLS loop_tripcount min = 4 max = 4
 
-                if (dict_string_start_pos[t][hash_value] != '\0')
+                // relative to the history before this job; older entries wrap around and are skipped
+                uint32_t dict_pos = dict_string_start_pos[t][hash_value] - job_base + history;
+
+                if (dict_string_start_pos[t][hash_value] != 0 && dict_pos < (uint32_t)(current_index + i) + history)
                 { // found a match
-                    compare_window_string_start_pos[t][i] = dict_string_start_pos[t][hash_value];
+                    compare_window_string_start_pos[t][i] = dict_pos - history;
+                    compare_window_string_bytes[t][i] = dict_pos < history ? dict_string_bytes[t][hash_value] : LEN;
                 COPY_LOOP_MATCHING:
                     for (int j = 0; j < LEN; j++)
                     {
@@ -276,6 +834,15 @@ CONTROL_LOOP:
                 }
             }
 
+            // a string of an earlier job is only matched up to the end of its job
+        CUT_AT_JOB_END:
+            for (int j = 0; j < VEC; j++)
+            {
+#pragma HLS UNROLL
+                if (length[j] > compare_window_string_bytes[i][j])
+                    length[j] = compare_window_string_bytes[i][j];
+            }
+
             // update best length
             // here, i is the index of dictionary
         UPDATE_BESTLENGTH:
@@ -303,13 +870,17 @@ CONTROL_LOOP:
 #pragma HLS UNROLL
 #pragma HLS loop_tripcount min = 4 max = 4
 
-            if (bestlength[i].length >= 3)
+            // the match must not run past the end of the job
+            int match_limit = size - (current_index + i);
+            int candidate_length = bestlength[i].length < match_limit ? bestlength[i].length : match_limit;
+
+            if (candidate_length >= 3)
             { // can be a candidate
-                if (i + bestlength[i].length > temp_valid_position)
+                if (i + candidate_length > temp_valid_position)
                 {
                     // find a later match
-                    temp_valid_position = i + bestlength[i].length;
-                    match_length = bestlength[i].length;
+                    temp_valid_position = i + candidate_length;
+                    match_length = candidate_length;
                     start_match_position = i;
                     offset = (current_index + i) - bestlength[i].string_start_pos;
                 }
@@ -327,11 +898,10 @@ CONTROL_LOOP:
 #pragma HLS UNROLL
 
                 // copy the literals
-                output[output_position] = curr_window[first_valid_position];
+                LZ77_write_literal(output, output_position, curr_window[first_valid_position]);
                 first_valid_position++;
-                output_position++;
             }
-            output[output_position] = '@';             // record marker		// There is a corner case here. If the input has '@', the marker is wrong.
+            output[output_position] = '@';             // record marker
             output[output_position + 1] = offset >> 7; // record offset
             output[output_position + 2] = (offset & 0x07F);
             output[output_position + 3] = match_length; // record length
@@ -347,9 +917,8 @@ CONTROL_LOOP:
 #pragma HLS PIPELINE
 #pragma HLS loop_tripcount min = 0 max = 1
 
-                output[output_position] = curr_window[first_valid_position];
+                LZ77_write_literal(output, output_position, curr_window[first_valid_position]);
                 first_valid_position++;
-                output_position++;
             }
         }
         else
@@ -363,9 +932,8 @@ CONTROL_LOOP:
 #pragma HLS loop_tripcount min = 0 max = 4
 
                 // copy the block to output
-                output[output_position] = curr_window[first_valid_position];
+                LZ77_write_literal(output, output_position, curr_window[first_valid_position]);
                 first_valid_position++;
-                output_position++;
             }
         }
 
@@ -386,28 +954,47 @@ CONTROL_LOOP:
                 dict[i][new_hash_value][j] = curr_window[i + j];
             }
 
-            dict_string_start_pos[i][new_hash_value] = current_index + i;
+            dict_string_start_pos[i][new_hash_value] = job_base + current_index + i;
+            dict_string_bytes[i][new_hash_value] = size - (current_index + i) < LEN ? size - (current_index + i) : LEN;
         }
 
         // Move the current window index by VEC bytes
         current_index += VEC;
     }
+#endif
 
-    // Fill the remaining bytes
+    // Fill the remaining bytes, curr_window[0] is byte current_index - VEC of the job
 FILL_LOOP_REMAINING_BYTES:
-    while (curr_window[first_valid_position] != '\0')
+    while (current_index - VEC + first_valid_position < size)
     {
 #pragma HLS UNROLL
 #pragma HLS PIPELINE
 #pragma HLS loop_tripcount min = 0 max = 4
-        output[output_position] = curr_window[first_valid_position];
+        LZ77_write_literal(output, output_position, curr_window[first_valid_position]);
         first_valid_position++;
-        output_position++;
     }
 
-    output[output_position] = '\0';
+    // drop the words after 'size' bytes, up to TLAST; a frame leaves them to the next frame
+DRAIN_INPUT:
+    while (drain && !done_input)
+    {
+#pragma HLS PIPELINE II = 1
+        input.read(input_axi_word);
+        done_input = input_axi_word.last;
+        perf.lz77_cycles++;
+        MODEL_ITERATION(MODEL_LZ77_DRAIN);
+    }
 
-    return;
+#ifdef DEFLATE_NATIVE
+    // keep the last LZ77_HISTORY bytes of the stream in front of the next job
+    memmove(job_window + VEC, job_window + VEC + size, LZ77_HISTORY);
+#endif
+
+    // the next job starts after this one
+    job_base += size;
+    perf.bytes_in = size;
+
+    return output_position;
 }
 
 /*
@@ -428,391 +1015,222 @@ FILL_LOOP_REMAINING_BYTES:
  * which could be another way to solve the problem.
  *
  * The static encoding part checks each input char and finds the corresponding code.
+ * It returns the number of bytes written to the output stream.
  * The dynamic part is not completely finished because the Huffman core cannot
  * get trees from CPU currently. However, all the essential parts for dynamic
  * Huffman encoding were finished, including building the trees and getting codes
  * through the trees. Some comments explain how to use hardware the build the
  * entire core.
  *
+ * For zlib and gzip, the container header and trailer are written around
+ * the block by the same bit buffer. The last word is written with TLAST if
+ * 'last' is set, else it is padded and more output follows.
+ *
+ * huffman fills the output counters of perf, and the matches and literals.
  */
 
-void huffman(uint8_t input[3000], hls::stream<uint32_t> &output)
+// Put a 32-bit lane (first byte in bits 31-24) into the stream word being packed
+static CORE_INLINE void encoder_pack_lane(encoder_output &out, uint32_t lane)
+{
+#pragma HLS INLINE
+    out.word |= (stream_data_t)lane << (STREAM_WIDTH - 32 * (out.word_lanes + 1));
+    out.word_lanes++;
+
+    return;
+}
+
+// Append up to 32 bits to the output bit buffer, pack a lane once more than 32 bits are ready,
+// and write the stream word once all its lanes are packed. At least one bit is always left
+// behind, so the last word of the job is written at the end, with TLAST.
+static CORE_INLINE void encoder_write_bits(hls::stream<axi_word> &output, encoder_output &out, uint32_t bits, unsigned bits_num)
 {
+#pragma HLS INLINE
+    out.bit_buffer |= (uint64_t)bits << out.bit_buffer_num;
+    out.bit_buffer_num += bits_num;
+
+    if (out.bit_buffer_num > 32)
+    {
+        encoder_pack_lane(out, byte_swap(out.bit_buffer));
+        out.bit_buffer >>= 32;
+        out.bit_buffer_num -= 32;
+        out.lanes_written++;
+
+        if (out.word_lanes == STREAM_WIDTH / 32)
+        {
+            if (output.full())
+                out.output_stalls++; // the write below waits for the output
+            output.write(make_axi_word(out.word, STREAM_BYTES, false));
+            out.word = 0;
+            out.word_lanes = 0;
+        }
+    }
+
+    return;
+}
 
-    int input_pos = 0, output_pos = 0;
-    unsigned length_valid_bits_num, offset_valid_bits_num,
-        output_char_remaining_bits, remaining_bits_to_output;
+unsigned huffman(uint8_t input[LZ77_BUFFER_SIZE], int input_size, hls::stream<axi_word> &output,
+                 unsigned format, const checksum_state &checksum, perf_counters &perf, bool last)
+{
+
+    int input_pos = 0;
+    unsigned length_valid_bits_num, length_extra_bits_num, offset_extra_bits_num;
     unsigned offset;
     uint8_t input_char, length;
-    uint8_t code_8_bits;
-    uint16_t code_9_bits;
-    uint16_t length_code, offset_code;
-    uint32_t length_and_offset;
-    uint8_t output_char_buffer;
+    uint16_t length_symbol, offset_symbol;
+    uint32_t code_bits;      // the codes and extra bits to write, LSB-first
+    unsigned code_bits_num;  // the number of valid bits in code_bits
 
-    // For hls_stream input
-    uint32_t output_word;
-    uint8_t output_buffer[3000]; // temp buffer for storing output data
+    unsigned container = format & FORMAT_CONTAINER;
+    bool sync_flush = format & FORMAT_SYNC_FLUSH;
+
+    // For hls_stream output
+    encoder_output out;
 
     short mode = 1;
     // mode indicates which type of Huffman encoding is used
     // mode = 0: no compression; mode = 1: static Huffman; mode = 2: dynamic Huffman
 
+    out.bit_buffer = 0;
+    out.bit_buffer_num = 0;
+    out.word = 0;
+    out.word_lanes = 0;
+    out.lanes_written = 0;
+    out.output_stalls = 0;
+
+    // the counters of perf, kept here while the symbols are written
+    unsigned huffman_cycles = 0, matches = 0, literals = 0;
+
+    // write the container header, bytes LSB-first; a continued stream has it already
+    bool header = !(format & FORMAT_CONTINUE);
+    if (header && container == FORMAT_ZLIB)
+    {
+        // CMF = 0x48: deflate with a 4K window; FLG = 0x0D: no dictionary, FCHECK
+        encoder_write_bits(output, out, 0x0D48, 16);
+    }
+    else if (header && container == FORMAT_GZIP)
+    {
+        // ID1 ID2 CM FLG, MTIME = 0, XFL = 0, OS = 255 (unknown)
+        encoder_write_bits(output, out, 0x00088B1F, 32);
+        encoder_write_bits(output, out, 0x00000000, 32);
+        encoder_write_bits(output, out, 0xFF00, 16);
+    }
+
     if (mode == 1)
     {
         // Static Huffman Encoding
-        // write the flag code of static Huffman encoding into output array
-        output_buffer[0] = 0xC0;
-        output_char_remaining_bits = 5;
+        // write the block header: BFINAL = 1 (0 before a sync flush), BTYPE = 01
+        encoder_write_bits(output, out, sync_flush ? 0x2 : 0x3, 3);
 
         // analyze the input
     STATIC_HUFFMAN:
-        while (input[input_pos] != '\0')
+        while (true)
         {
+#pragma HLS PIPELINE II = 1
+#ifdef DEFLATE_NATIVE
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            // the literals below 0x80 up to the next '@', eight at a time: their codes are
+            // 0x30 + the byte, 8 bits, reversed (FIXED_LIT_TABLE); the first byte is the low byte
+            while (input_pos + 8 <= input_size)
+            {
+                uint64_t bytes, codes;
+                memcpy(&bytes, &input[input_pos], sizeof(bytes));
+                int plain = LZ77_ascii_literals(bytes);
+                unsigned bits_num = 8 * plain;
+
+                codes = bytes + 0x3030303030303030ull;
+                codes = (codes >> 4 & 0x0F0F0F0F0F0F0F0Full) | (codes & 0x0F0F0F0F0F0F0F0Full) << 4;
+                codes = (codes >> 2 & 0x3333333333333333ull) | (codes & 0x3333333333333333ull) << 2;
+                codes = (codes >> 1 & 0x5555555555555555ull) | (codes & 0x5555555555555555ull) << 1;
+                codes &= plain < 8 ? (1ull << bits_num) - 1 : ~0ull;
+                encoder_write_bits(output, out, (uint32_t)codes, bits_num < 32 ? bits_num : 32);
+                encoder_write_bits(output, out, (uint32_t)(codes >> 32), bits_num > 32 ? bits_num - 32 : 0);
+                input_pos += plain;
+                literals += plain;
+                huffman_cycles += plain;
+                if (plain < 8)
+                    break;
+            }
+#endif
+            // three literals with one write to the bit buffer (at most 27 bits),
+            // while the next four bytes have no '@'
+            uint32_t next_bytes;
+            while (input_pos + 4 <= input_size && (memcpy(&next_bytes, &input[input_pos], 4), !LZ77_has_at(next_bytes)))
+            {
+                const code_table_node &first = FIXED_LIT_TABLE[input[input_pos]];
+                const code_table_node &second = FIXED_LIT_TABLE[input[input_pos + 1]];
+                const code_table_node &third = FIXED_LIT_TABLE[input[input_pos + 2]];
+
+                code_bits = first.code | (uint32_t)second.code << first.valid_length |
+                            (uint32_t)third.code << (first.valid_length + second.valid_length);
+                encoder_write_bits(output, out, code_bits, first.valid_length + second.valid_length + third.valid_length);
+                input_pos += 3;
+                literals += 3;
+                huffman_cycles += 3;
+            }
+#endif
+            MODEL_ITERATION(MODEL_STATIC_HUFFMAN);
+            bool end_of_block = input_pos >= input_size;
             input_char = input[input_pos];
 
-            if (input_char == '@')
+            if (end_of_block)
+            {
+                // finish encoding, edoc: 256
+                code_bits = FIXED_LIT_TABLE[256].code;
+                code_bits_num = FIXED_LIT_TABLE[256].valid_length;
+            }
+            else if (input_char == '@' && input[input_pos + 1] == LZ77_LITERAL_AT)
+            {
+                // an escaped literal '@'
+                code_bits = FIXED_LIT_TABLE['@'].code;
+                code_bits_num = FIXED_LIT_TABLE['@'].valid_length;
+
+                input_pos += 2;
+                literals++;
+            }
+            else if (input_char == '@')
             {
                 // meet a match
                 length = input[input_pos + 3];
-
-                if (length >= 115 || length < 3)
-                {
-                    // currently, impossible to enter here
-                    cout << "The matching length is too long or too short! Wrong!"
-                         << endl;
-                }
-                else
-                {
-
-                    // edoc: 257-279
-                    if (length >= 3 && length <= 10)
-                    {
-                        // 257-264, no extra bit
-                        length_code = length - 2;
-                        length_valid_bits_num = 7;
-                    }
-                    else if (length == 11 || length == 12)
-                    {
-                        // 265-268, 1 extra bit
-                        length_code = 0b00010010 + (length - 11);
-                        length_valid_bits_num = 8;
-                    }
-                    else if (length == 13 || length == 14)
-                    {
-                        // 265-268, 1 extra bit
-                        length_code = 0b00010100 + (length - 13);
-                        length_valid_bits_num = 8;
-                    }
-                    else if (length == 15 || length == 16)
-                    {
-                        // 265-268, 1 extra bit
-                        length_code = 0b00010110 + (length - 15);
-                        length_valid_bits_num = 8;
-                    }
-                    else if (length == 17 || length == 18)
-                    {
-                        // 265-268, 1 extra bit
-                        length_code = 0b00011000 + (length - 17);
-                        length_valid_bits_num = 8;
-                    }
-                    else if (length >= 19 && length <= 22)
-                    {
-                        // 269-272, 2 extra bits
-                        length_code = 0b000110100 + (length - 19);
-                        length_valid_bits_num = 9;
-                    }
-                    else if (length >= 23 && length <= 26)
-                    {
-                        // 269-272, 2 extra bits
-                        length_code = 0b000111000 + (length - 23);
-                        length_valid_bits_num = 9;
-                    }
-                    else if (length >= 27 && length <= 30)
-                    {
-                        // 269-272, 2 extra bits
-                        length_code = 0b000111100 + (length - 27);
-                        length_valid_bits_num = 9;
-                    }
-                    else if (length >= 31 && length <= 34)
-                    {
-                        // 269-272, 2 extra bits
-                        length_code = 0b001000000 + (length - 31);
-                        length_valid_bits_num = 9;
-                    }
-                    else if (length >= 35 && length <= 42)
-                    {
-                        // 273-276, 3 extra bits
-                        length_code = 0b0010001000 + (length - 35);
-                        length_valid_bits_num = 10;
-                    }
-                    else if (length >= 43 && length <= 50)
-                    {
-                        // 273-276, 3 extra bits
-                        length_code = 0b0010010000 + (length - 43);
-                        length_valid_bits_num = 10;
-                    }
-                    else if (length >= 51 && length <= 58)
-                    {
-                        // 273-276, 3 extra bits
-                        length_code = 0b0010011000 + (length - 51);
-                        length_valid_bits_num = 10;
-                    }
-                    else if (length >= 59 && length <= 66)
-                    {
-                        // 273-276, 3 extra bits
-                        length_code = 0b0010100000 + (length - 59);
-                        length_valid_bits_num = 10;
-                    }
-                    else if (length >= 67 && length <= 82)
-                    {
-                        // 277-279, 4 extra bits
-                        length_code = 0b00101010000 + (length - 67);
-                        length_valid_bits_num = 11;
-                    }
-                    else if (length >= 83 && length <= 98)
-                    {
-                        // 277-279, 4 extra bits
-                        length_code = 0b00101100000 + (length - 83);
-                        length_valid_bits_num = 11;
-                    }
-                    else if (length >= 99 && length <= 114)
-                    {
-                        // 277-279, 4 extra bits
-                        length_code = 0b00101110000 + (length - 99);
-                        length_valid_bits_num = 11;
-                    }
-                    else
-                    {
-                        cout << "Wrong! Cannot find the correct length code!"
-                             << endl;
-                    }
-                }
-
                 offset = input[input_pos + 1] * 128 + input[input_pos + 2];
 
-                if (offset >= 1 && offset <= 4)
-                {
-                    offset_code = offset - 1;
-                    offset_valid_bits_num = 5;
-                }
-                else if (offset >= 5 && offset <= 6)
-                {
-                    offset_code = 0b001000 + (offset - 5);
-                    offset_valid_bits_num = 6;
-                }
-                else if (offset >= 7 && offset <= 8)
-                {
-                    offset_code = 0b001010 + (offset - 7);
-                    offset_valid_bits_num = 6;
-                }
-                else if (offset >= 9 && offset <= 12)
-                {
-                    offset_code = 0b0011000 + (offset - 9);
-                    offset_valid_bits_num = 7;
-                }
-                else if (offset >= 13 && offset <= 16)
-                {
-                    offset_code = 0b0011100 + (offset - 13);
-                    offset_valid_bits_num = 7;
-                }
-                else if (offset >= 17 && offset <= 24)
-                {
-                    offset_code = 0b01000000 + (offset - 17);
-                    offset_valid_bits_num = 8;
-                }
-                else if (offset >= 25 && offset <= 32)
-                {
-                    offset_code = 0b01001000 + (offset - 25);
-                    offset_valid_bits_num = 8;
-                }
-                else if (offset >= 33 && offset <= 48)
-                {
-                    offset_code = 0b010100000 + (offset - 33);
-                    offset_valid_bits_num = 9;
-                }
-                else if (offset >= 49 && offset <= 64)
-                {
-                    offset_code = 0b010110000 + (offset - 49);
-                    offset_valid_bits_num = 9;
-                }
-                else if (offset >= 65 && offset <= 96)
-                {
-                    offset_code = 0b0110000000 + (offset - 65);
-                    offset_valid_bits_num = 10;
-                }
-                else if (offset >= 97 && offset <= 128)
-                {
-                    offset_code = 0b0110100000 + (offset - 97);
-                    offset_valid_bits_num = 10;
-                }
-                else if (offset >= 129 && offset <= 192)
-                {
-                    offset_code = 0b01110000000 + (offset - 129);
-                    offset_valid_bits_num = 11;
-                }
-                else if (offset >= 193 && offset <= 256)
-                {
-                    offset_code = 0b01111000000 + (offset - 193);
-                    offset_valid_bits_num = 11;
-                }
-                else if (offset >= 257 && offset <= 384)
-                {
-                    offset_code = 0b100000000000 + (offset - 257);
-                    offset_valid_bits_num = 12;
-                }
-                else if (offset >= 385 && offset <= 512)
-                {
-                    offset_code = 0b100010000000 + (offset - 385);
-                    offset_valid_bits_num = 12;
-                }
-                else if (offset >= 513 && offset <= 768)
-                {
-                    offset_code = 0b1001000000000 + (offset - 513);
-                    offset_valid_bits_num = 13;
-                }
-                else if (offset >= 769 && offset <= 1024)
-                {
-                    offset_code = 0b1001100000000 + (offset - 769);
-                    offset_valid_bits_num = 13;
-                }
-                else if (offset >= 1025 && offset <= 1536)
-                {
-                    offset_code = 0b10100000000000 + (offset - 1025);
-                    offset_valid_bits_num = 14;
-                }
-                else if (offset >= 1537 && offset <= 2048)
-                {
-                    offset_code = 0b10101000000000 + (offset - 1537);
-                    offset_valid_bits_num = 14;
-                }
-                else if (offset >= 2049 && offset <= 3072)
-                {
-                    offset_code = 0b101100000000000 + (offset - 2049);
-                    offset_valid_bits_num = 15;
-                }
-                else if (offset >= 3073 && offset <= 4096)
-                {
-                    offset_code = 0b101110000000000 + (offset - 3073);
-                    offset_valid_bits_num = 15;
-                }
-                else
-                {
-                    cout << "Wrong! Offset is out of range!" << endl;
-                }
-
-                // write the length_code and offset_code into the output
-
-                // combine length and offset codes
-                remaining_bits_to_output = length_valid_bits_num + offset_valid_bits_num;
-                length_and_offset = (length_code << (32 - length_valid_bits_num)) | (offset_code << (32 - remaining_bits_to_output));
-
-                if (output_char_remaining_bits != 8)
-                {
-                    // not a 8-bit boundary to start, move the 8-bit boundary
-                    output_char_buffer = length_and_offset >> (32 - output_char_remaining_bits);
-                    output_buffer[output_pos] = output_buffer[output_pos] | output_char_buffer;
-
-                    length_and_offset <<= output_char_remaining_bits;
-                    remaining_bits_to_output -= output_char_remaining_bits;
-                    output_char_remaining_bits = 8;
-                    output_pos++;
-                }
-
-                // starting at 8-bit boundary, iteration to write into the output array
-            STATIC_HUFFMAN_WRITE_OUTPUT:
-                while (remaining_bits_to_output >= 8)
-                {
-                    // can write to the next whole char
-                    output_buffer[output_pos++] = (length_and_offset & 0xFF000000) >> 24;
-                    length_and_offset <<= 8;
-                    remaining_bits_to_output -= 8;
-                }
-
-                if (remaining_bits_to_output == 0)
-                {
-                    // do nothing
-                }
-                else
-                {
-                    // follow-up steps: output the remaining bits (less than 8)
-                    output_buffer[output_pos] = length_and_offset >> 24;
-                    output_char_remaining_bits = 8 - remaining_bits_to_output;
-                }
+                // edoc: 257-285, followed by the extra bits
+                length_symbol = LENGTH_SYMBOL[length];
+                length_valid_bits_num = FIXED_LIT_TABLE[length_symbol].valid_length;
+                length_extra_bits_num = LENGTH_EXTRA[length_symbol - 257];
+
+                // distance code: 5 bits, followed by the extra bits
+                offset_symbol = (offset - 1) < 256 ? DIST_SYMBOL[offset - 1] : DIST_SYMBOL[256 + ((offset - 1) >> 7)];
+                offset_extra_bits_num = DIST_EXTRA[offset_symbol];
+
+                // combine length and offset codes, at most 8 + 5 + 5 + 13 bits
+                code_bits = FIXED_LIT_TABLE[length_symbol].code;
+                code_bits_num = length_valid_bits_num;
+                code_bits |= (length - LENGTH_BASE[length_symbol - 257]) << code_bits_num;
+                code_bits_num += length_extra_bits_num;
+                code_bits |= FIXED_DIST_TABLE[offset_symbol].code << code_bits_num;
+                code_bits_num += FIXED_DIST_TABLE[offset_symbol].valid_length;
+                code_bits |= (offset - DIST_BASE[offset_symbol]) << code_bits_num;
+                code_bits_num += offset_extra_bits_num;
 
                 input_pos += 4;
+                matches++;
             }
             else
             {
-                // normal literals
-                if (input_char <= 143)
-                {
-                    // edoc: 0-143
-                    code_8_bits = input_char + 0x30;
-
-                    // write the literal code into the output
-                    if (output_char_remaining_bits == 8)
-                    {
-                        // enough space to store the literal in this position
-                        output_buffer[output_pos++] = code_8_bits;
-                    }
-                    else
-                    {
-                        // not enough to store the 8 bit literal code
-                        output_char_buffer = code_8_bits >> (8 - output_char_remaining_bits);
-                        output_buffer[output_pos] = output_buffer[output_pos] | output_char_buffer;
-
-                        output_pos++;
-                        output_buffer[output_pos] = code_8_bits << output_char_remaining_bits;
-                    }
-                }
-                else
-                {
-                    // edoc: 144-255
-                    code_9_bits = input_char - 144 + 0x190;
-
-                    // not enough to store the 9 bit literal code
-                    output_char_buffer = code_9_bits >> (9 - output_char_remaining_bits);
-                    output_buffer[output_pos] = output_buffer[output_pos] | output_char_buffer;
-
-                    output_char_buffer = code_9_bits << output_char_remaining_bits;
-                    output_buffer[output_pos + 1] = output_char_buffer;
-                    output_char_remaining_bits--;
-
-                    if (output_char_remaining_bits == 0)
-                    {
-                        output_pos += 2;
-                        output_char_remaining_bits = 8;
-                    }
-                    else
-                    {
-                        output_pos++;
-                    }
-                }
+                // normal literals, edoc: 0-255
+                code_bits = FIXED_LIT_TABLE[input_char].code;
+                code_bits_num = FIXED_LIT_TABLE[input_char].valid_length;
 
                 input_pos++;
+                literals++;
             }
-        }
-
-        // finish encoding, edoc: 256
-        if (output_char_remaining_bits == 8)
-        {
-            output_buffer[output_pos] = '\0';
-        }
-        else
-        {
-            output_buffer[output_pos + 1] = '\0';
-        }
 
-        // Store output_buffer data into output stream
-        output_pos++;
-        int copy_count = (output_pos + 1) / 4;
-        copy_count++;
+            // append the codes to the bit buffer
+            encoder_write_bits(output, out, code_bits, code_bits_num);
+            huffman_cycles++;
 
-        for (int i = 0; i < copy_count; i++)
-        {
-            output_word = (reverse(output_buffer[i * 4], 8) << 24) | (reverse(output_buffer[i * 4 + 1], 8) << 16) | (reverse(output_buffer[i * 4 + 2], 8) << 8) | (reverse(output_buffer[i * 4 + 3], 8));
-            output.write(output_word);
+            if (end_of_block)
+                break;
         }
     }
     else if (mode == 2)
@@ -1136,7 +1554,49 @@ void huffman(uint8_t input[3000], hls::stream<uint32_t> &output)
         //        /********************************************************************/
     }
 
-    return;
+    if (sync_flush)
+    {
+        // an empty stored block: BFINAL = 0, BTYPE = 00, then LEN = 0 and NLEN = 0xFFFF at the next byte boundary
+        encoder_write_bits(output, out, 0x0, 3);
+        out.bit_buffer_num = (out.bit_buffer_num + 7) & ~0x7u;
+        encoder_write_bits(output, out, 0xFFFF0000, 32);
+    }
+    else
+    {
+        // write the container trailer at the next byte boundary
+        out.bit_buffer_num = (out.bit_buffer_num + 7) & ~0x7u;
+
+        if (container == FORMAT_ZLIB)
+        {
+            // Adler-32, MSB first
+            encoder_write_bits(output, out, byte_swap(checksum_adler32(checksum)), 32);
+        }
+        else if (container == FORMAT_GZIP)
+        {
+            // CRC-32 and ISIZE, LSB first
+            encoder_write_bits(output, out, checksum_crc32(checksum), 32);
+            encoder_write_bits(output, out, checksum.size, 32);
+        }
+    }
+
+    // the exact number of compressed bytes, the output is byte aligned
+    unsigned output_bytes = out.lanes_written * 4 + out.bit_buffer_num / 8;
+
+    // pack the remaining 1-4 bytes and write the last word, padded with zeros; with TLAST and
+    // the valid bytes in TKEEP, or all bytes kept when more output follows (a frame)
+    unsigned last_bytes = out.word_lanes * 4 + out.bit_buffer_num / 8;
+    encoder_pack_lane(out, byte_swap(out.bit_buffer));
+    if (output.full())
+        out.output_stalls++;
+    output.write(make_axi_word(out.word, last ? last_bytes : STREAM_BYTES, last));
+
+    perf.huffman_cycles = huffman_cycles;
+    perf.matches = matches;
+    perf.literals = literals;
+    perf.bytes_out = output_bytes;
+    perf.output_stalls = out.output_stalls;
+
+    return output_bytes;
 }
 
 // The two functions below are for dynamic Huffman encoding.
@@ -1214,19 +1674,3 @@ void get_lit_huffman_code(tree_node literal_tree[600], code_table_node lit_codes
 
     return;
 }
-
-// Reverse bits to change endianness
-template <typename T>
-T reverse(T n, unsigned bits_num)
-{
-    T rv = 0;
-REVERSE_BITS:
-    for (int i = 0; i < bits_num; i++)
-    {
-#pragma HLS PIPELINE
-        rv <<= 1;
-        rv |= (n & 0x01);
-        n >>= 1;
-    }
-    return rv;
-}
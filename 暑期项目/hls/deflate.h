@@ -9,16 +9,144 @@
 #define DEFLATE_H
 
 #include <iostream>
-#include "ap_int.h"
 #include <stdint.h>
+#ifdef DEFLATE_NATIVE
+#include "native.h" // plain C++ types, see native.h
+#else
+#include "ap_int.h"
 #include "hls_stream.h"
+#include "ap_axi_sdata.h"
+#endif
 using namespace std;
 
+// Variables kept from job to job. The native build keeps them per thread, so
+// that host threads can run a core each (see host.h).
+#ifdef DEFLATE_NATIVE
+#define CORE_STATE static thread_local
+#else
+#define CORE_STATE static
+#endif
+
+// Helpers run for each word or symbol, with HLS INLINE. The pragma is ignored
+// in the native build, so they are forced inline there.
+#ifdef DEFLATE_NATIVE
+#define CORE_INLINE __attribute__((always_inline)) inline
+#else
+#define CORE_INLINE
+#endif
+
 #define VEC 4                // operates VEC bytes per iteration
 #define LEN 32               // max matching length is LEN
 #define NUM_DICT 4           // number of dictionaries, should be the same as VEC
 #define HASH_TABLE_SIZE 2048 // the size of each dictionary
 
+// Data width of the AXI-Stream ports of both cores: 32, 64 or 128 bits.
+// Set at build time, e.g. -DSTREAM_WIDTH=64 to match a 64-bit DMA and HP port.
+#ifndef STREAM_WIDTH
+#define STREAM_WIDTH 32
+#endif
+#if STREAM_WIDTH != 32 && STREAM_WIDTH != 64 && STREAM_WIDTH != 128
+#error "STREAM_WIDTH must be 32, 64 or 128"
+#endif
+#define STREAM_BYTES (STREAM_WIDTH / 8) // bytes per stream word
+#if STREAM_BYTES % VEC != 0 && VEC % STREAM_BYTES != 0
+#error "STREAM_BYTES and VEC must divide one another"
+#endif
+
+#define MAX_JOB_SIZE 4096                       // max number of bytes of one job, bounded by the on-chip buffers
+#define LZ77_BUFFER_SIZE (2 * MAX_JOB_SIZE + 4) // LZ77 output; a literal '@' takes 2 bytes
+#define LZ77_LITERAL_AT 0x80                    // '@', LZ77_LITERAL_AT is a literal '@', not a match
+#define LZ77_HISTORY 4095                       // bytes before a job its matches reach with FORMAT_CONTINUE
+
+// Absolute position of the LZ77 dictionaries after which they are rebased, long
+// before the positions wrap; set lower at build time to test the rebase.
+#ifndef LZ77_REBASE
+#define LZ77_REBASE 0x80000000
+#endif
+
+// LZ77 tokens passed from huffman_decoder to LZ77_decoder, one uint32_t each
+#define TOKEN_TYPE 0xC0000000    // bits 31-30: type of the token
+#define TOKEN_LITERAL 0x00000000 // bits 7-0: the literal
+#define TOKEN_MATCH 0x40000000   // bits 24-16: length, bits 15-0: offset
+#define TOKEN_END 0x80000000     // end of the decoded stream, bits 1-0: INFLATE_* errors
+
+// Container format around the DEFLATE stream, selected per job
+#define FORMAT_RAW 0  // raw DEFLATE stream (rfc1951)
+#define FORMAT_ZLIB 1 // 2-byte header, Adler-32 trailer (rfc1950)
+#define FORMAT_GZIP 2 // 10-byte header, CRC-32 and ISIZE trailer (rfc1952)
+#define FORMAT_CONTAINER 0x3  // bits 1-0 of 'format': the container above
+#define FORMAT_SYNC_FLUSH 0x4 // flag: end with a sync flush instead of the last block, see deflate.cpp
+#define FORMAT_FRAMED 0x8     // flag of Deflate: the job is a batch of frames, each its own stream, see deflate.cpp
+#define MAX_FRAMES 256        // frames of one framed job
+#define FORMAT_CONTINUE 0x20  // flag of Deflate: the job goes on with the stream of the last job, see deflate.cpp
+
+// Header and trailer bytes of each container (FORMAT_RAW/ZLIB/GZIP), as the cores write them
+static const unsigned HEADER_BYTES[3] = {0, 2, 10};
+static const unsigned TRAILER_BYTES[3] = {0, 4, 8};
+
+// Batch jobs of Deflate_batch: a descriptor is 4 words in the descriptor ring,
+// a completion record is 2 words in the completion ring, see deflate_mm.cpp
+#define DESC_WORDS 4              // src, size, dst, flags
+#define DESC_SRC 0                // byte offset of the input in memory, STREAM_BYTES aligned
+#define DESC_SIZE 1               // input bytes, up to MAX_JOB_SIZE
+#define DESC_DST 2                // byte offset of the output in memory, STREAM_BYTES aligned
+#define DESC_FLAGS 3              // bits 2-0: FORMAT_*, bits 31-16: capacity of the output in bytes
+#define COMPLETION_WORDS 2        // compressed size, status
+#define JOB_DONE 0x80000000       // status: the record is written
+#define JOB_OUTPUT_OVERFLOW 0x1   // status: the compressed job did not fit, the output is truncated
+#define JOB_INPUT_TOO_LARGE 0x2   // status: size exceeds MAX_JOB_SIZE, the job is skipped
+
+// Status of a decompression job, ORed together
+#define INFLATE_OK 0x0
+#define INFLATE_HEADER_ERROR 0x1   // unsupported or corrupted zlib/gzip header
+#define INFLATE_DATA_ERROR 0x2     // invalid block type or code, truncated stream, or codes over 9 (literal) / 6 (distance) bits
+#define INFLATE_CHECKSUM_ERROR 0x4 // Adler-32, CRC-32 or ISIZE mismatch
+#define CODEC_OPCODE_ERROR 0x8     // Codec: unknown opcode, the job is dropped
+
+// Performance counters of the last job, the 'perf' register array of the top levels.
+// On inflate, the LZ77 and Huffman counters are those of the LZ77 and Huffman decoders.
+#define PERF_BYTES_IN 0       // bytes of the input job
+#define PERF_BYTES_OUT 1      // bytes of the output job
+#define PERF_LZ77_CYCLES 2    // iterations of the LZ77 stage, one cycle each at II = 1
+#define PERF_HUFFMAN_CYCLES 3 // iterations of the Huffman stage, one cycle each at II = 1
+#define PERF_INPUT_STALLS 4   // input words that were not ready when read (DMA too slow)
+#define PERF_OUTPUT_STALLS 5  // output words that could not be written at once (sink too slow)
+#define PERF_MATCHES 6        // matches of the job
+#define PERF_LITERALS 7       // literals of the job
+#define PERF_NUM 8
+
+// Cycle model of C simulation, see cycle_model.cpp. Each main loop counts its
+// iterations with MODEL_ITERATION(MODEL_*); the counting is left out of synthesis
+// and of the native build, where MODEL_ENABLED is 0 and there are no cycles to report.
+#define MODEL_CONTROL_LOOP 0       // Deflate: LZ77 CONTROL_LOOP, not pipelined
+#define MODEL_FILL_LOOP 1          // Deflate: FILL_LOOP_*, one LZ77 output entry per iteration
+#define MODEL_LZ77_DRAIN 2         // Deflate: DRAIN_INPUT of LZ77
+#define MODEL_STATIC_HUFFMAN 3     // Deflate: STATIC_HUFFMAN
+#define MODEL_UNPACK_LOOP 4        // inflate: UNPACK_LOOP of stream_unpack
+#define MODEL_GET_CCL 5            // inflate: GET_CCL of a dynamic block
+#define MODEL_DECODE_CL 6          // inflate: DECODE_CL of a dynamic block
+#define MODEL_BUILD_TABLES 7       // inflate: the Huffman tables of a dynamic block, once per block
+#define MODEL_STORED_COPY 8        // inflate: STORED_COPY
+#define MODEL_DECODE_MAIN_LOOP 9   // inflate: DECODE_MAIN_LOOP
+#define MODEL_LZ77_MAIN_LOOP 10    // inflate: LZ77_MAIN_LOOP of LZ77_decoder
+#define MODEL_COPY_MATCHED_CHAR 11 // inflate: COPY_MATCHED_CHAR
+#define MODEL_LZ77_OUTPUT 12       // inflate: LZ77_OUTPUT
+#define MODEL_LOOPS 13
+#define MODEL_CLOCK_MHZ 100 // FCLK0 of the PS in vivado/design_1.tcl
+
+#if !defined(__SYNTHESIS__) && !defined(DEFLATE_NATIVE)
+#define MODEL_ENABLED 1
+extern uint64_t model_iterations[MODEL_LOOPS];
+#define MODEL_ITERATION(loop) (model_iterations[loop]++)
+#else
+#define MODEL_ENABLED 0
+#define MODEL_ITERATION(loop)
+#endif
+
+// Operation of a Codec job
+#define OP_DEFLATE 0 // compress
+#define OP_INFLATE 1 // decompress
+
 //typedef ap_uint<8> uint8_t;
 //typedef ap_uint<16> uint16_t;
 //typedef ap_uint<32> uint32_t;
@@ -30,6 +158,16 @@ typedef ap_uint<6> uint6_t;
 typedef ap_uint<7> uint7_t;
 typedef ap_uint<9> uint9_t;
 
+// AXI-Stream word of the top-level ports. The first byte is in the top bits
+// (bits 31-24 of a 32-bit word). TLAST marks the last word of a job; TKEEP
+// marks the valid bytes. The bytes of a partial last word are in the low lanes,
+// still first byte first (make_axi_word(), stream_data()).
+typedef ap_uint<STREAM_WIDTH> stream_data_t;
+typedef ap_axiu<STREAM_WIDTH, 1, 1, 1> axi_word;
+
+// 32-bit word inside the Inflate core, the unit of the bit buffer refill
+typedef ap_axiu<32, 1, 1, 1> axi_word_32;
+
 struct match_pair
 {
     int string_start_pos; // record the start position of the matched string in bestlength[]
@@ -72,31 +210,274 @@ struct Lookup_Node
     unsigned valid_bits; // the valid bits of the symbol from MSB
 };
 
-void Deflate(hls::stream<uint32_t> &input, hls::stream<uint32_t> &output);
-void inflate(hls::stream<uint32_t> &input, hls::stream<uint32_t> &output);
+// Symbol of a lookup entry no code maps to, beyond every alphabet
+#define LOOKUP_NO_CODE 511
+
+struct checksum_state
+{
+    // running checksums of the uncompressed data, see checksum.cpp
+    uint32_t crc;     // CRC-32 register, inverted
+    uint32_t adler_a; // Adler-32 sum of the bytes, mod 65521
+    uint32_t adler_b; // Adler-32 sum of the a values, mod 65521
+    uint32_t size;    // number of bytes, mod 2^32 (gzip ISIZE)
+};
+
+struct perf_counters
+{
+    // performance counters of one job, see PERF_*
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+    uint32_t lz77_cycles;
+    uint32_t huffman_cycles;
+    uint32_t input_stalls;
+    uint32_t output_stalls;
+    uint32_t matches;
+    uint32_t literals;
+};
+
+struct encoder_output
+{
+    // output side of the Huffman encoder
+    uint64_t bit_buffer;     // LSB-first bit accumulator, up to 64 bits
+    unsigned bit_buffer_num; // the number of valid bits in bit_buffer
+    stream_data_t word;      // the stream word being packed, 32 bits at a time from the top
+    unsigned word_lanes;     // the number of 32-bit lanes of word filled
+    unsigned lanes_written;  // the number of 32-bit lanes written to the output stream
+    unsigned output_stalls;  // the number of words that found the output stream full
+};
+
+/*
+ * Static (fixed) Huffman tables, RFC 1951 section 3.2.6.
+ *
+ * The tables are generated at compile time by the constexpr functions below
+ * and become ROMs shared by the Deflate and Inflate cores. Both cores move
+ * bits LSB-first, so the codes in code_table_node::code are pre-reversed and
+ * the decoder ROMs are indexed by the next bits of the stream, LSB-first.
+ */
+
+constexpr unsigned floor_log2(unsigned v)
+{
+    return v <= 1 ? 0 : 1 + floor_log2(v >> 1);
+}
+
+// Reverse the lower n bits of v
+constexpr unsigned reverse_bits(unsigned v, unsigned n)
+{
+    return n == 0 ? 0 : ((v & 0x1) << (n - 1)) | reverse_bits(v >> 1, n - 1);
+}
+
+// Fixed code of a literal/length symbol (0-287)
+constexpr unsigned fixed_lit_code(unsigned symbol)
+{
+    return symbol < 144 ? 0x30 + symbol : symbol < 256 ? 0x190 + (symbol - 144) : symbol < 280 ? symbol - 256 : 0xC0 + (symbol - 280);
+}
+
+// Fixed code length of a literal/length symbol (0-287)
+constexpr unsigned fixed_lit_length(unsigned symbol)
+{
+    return symbol < 144 ? 8 : symbol < 256 ? 9 : symbol < 280 ? 7 : 8;
+}
+
+// Literal/length symbol of the fixed code starting at the MSB of a 9-bit window
+constexpr unsigned fixed_window_symbol(unsigned window)
+{
+    return (window >> 2) <= 0x17 ? 256 + (window >> 2) : (window >> 1) <= 0xBF ? (window >> 1) - 0x30 : (window >> 1) <= 0xC7 ? 280 + (window >> 1) - 0xC0 : 144 + window - 0x190;
+}
+
+// Literal/length symbol of the fixed code in the next 9 bits of the stream (LSB-first)
+constexpr unsigned fixed_lookup_symbol(unsigned index)
+{
+    return fixed_window_symbol(reverse_bits(index, 9));
+}
+
+// Length of the fixed code in the next 9 bits of the stream (LSB-first)
+constexpr unsigned fixed_lookup_length(unsigned index)
+{
+    return fixed_lit_length(fixed_lookup_symbol(index));
+}
+
+// Length symbol (257-285) of a matching length (3-258)
+constexpr unsigned length_symbol(unsigned length)
+{
+    return length <= 10 ? 254 + length : length == 258 ? 285 : 257 + 4 * (floor_log2(length - 3) - 2) + ((length - 3) >> (floor_log2(length - 3) - 2));
+}
+
+// Distance symbol (0-29) of distance - 1 (0-32767)
+constexpr unsigned distance_symbol(unsigned dist)
+{
+    return dist < 4 ? dist : 2 * floor_log2(dist) + ((dist >> (floor_log2(dist) - 1)) & 0x1);
+}
+
+// Helper macros to expand a constexpr generator into ROM initializers
+#define ROM_4(f, n) f(n), f(n + 1), f(n + 2), f(n + 3)
+#define ROM_16(f, n) ROM_4(f, n), ROM_4(f, n + 4), ROM_4(f, n + 8), ROM_4(f, n + 12)
+#define ROM_64(f, n) ROM_16(f, n), ROM_16(f, n + 16), ROM_16(f, n + 32), ROM_16(f, n + 48)
+#define ROM_256(f, n) ROM_64(f, n), ROM_64(f, n + 64), ROM_64(f, n + 128), ROM_64(f, n + 192)
+
+#define FIXED_LIT_ENTRY(n) {reverse_bits(fixed_lit_code(n), fixed_lit_length(n)), fixed_lit_length(n)}
+#define FIXED_DIST_ENTRY(n) {reverse_bits(n, 5), 5}
+#define FIXED_LOOKUP_LIT_ENTRY(n) {fixed_lookup_symbol(n), fixed_lookup_length(n)}
+#define FIXED_LOOKUP_DIST_ENTRY(n) {reverse_bits((n) & 0x1F, 5), 5}
+#define LENGTH_SYMBOL_ENTRY(n) ((n) < 3 ? 0 : length_symbol(n))
+#define DIST_SYMBOL_ENTRY(n) ((n) < 256 ? distance_symbol(n) : distance_symbol(((n) - 256) << 7))
+
+// Encoder ROM: fixed code of each literal/length symbol
+static const code_table_node FIXED_LIT_TABLE[288] = {
+    ROM_256(FIXED_LIT_ENTRY, 0), ROM_16(FIXED_LIT_ENTRY, 256), ROM_16(FIXED_LIT_ENTRY, 272)};
+
+// Encoder ROM: fixed code of each distance symbol
+static const code_table_node FIXED_DIST_TABLE[32] = {
+    ROM_16(FIXED_DIST_ENTRY, 0), ROM_16(FIXED_DIST_ENTRY, 16)};
+
+// Decoder ROM: 9-bit first level lookup of the fixed literal/length codes
+static const Lookup_Node FIXED_LOOKUP_LIT[512] = {
+    ROM_256(FIXED_LOOKUP_LIT_ENTRY, 0), ROM_256(FIXED_LOOKUP_LIT_ENTRY, 256)};
+
+// Decoder ROM: 6-bit first level lookup of the fixed (5-bit) distance codes
+static const Lookup_Node FIXED_LOOKUP_DIST[64] = {
+    ROM_64(FIXED_LOOKUP_DIST_ENTRY, 0)};
+
+// Length symbol of each matching length; index is the length itself
+static const uint16_t LENGTH_SYMBOL[259] = {
+    ROM_256(LENGTH_SYMBOL_ENTRY, 0), LENGTH_SYMBOL_ENTRY(256), LENGTH_SYMBOL_ENTRY(257), LENGTH_SYMBOL_ENTRY(258)};
+
+// Distance symbol of distance - 1; use [d] for d < 256, else [256 + (d >> 7)]
+static const uint8_t DIST_SYMBOL[512] = {
+    ROM_256(DIST_SYMBOL_ENTRY, 0), ROM_256(DIST_SYMBOL_ENTRY, 256)};
 
-void LZ77(hls::stream<uint32_t> &input, int size, uint8_t output[3000]);
-void LZ77_decoder(uint8_t input[3000], hls::stream<uint32_t> &output);
+// Base value and number of extra bits of each length symbol (257-285)
+static const uint16_t LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
 
-void huffman(uint8_t input[3000], hls::stream<uint32_t> &output);
-void huffman_decoder(hls::stream<uint32_t> &input, uint8_t decoding_output[3000]);
+// Base value and number of extra bits of each distance symbol (0-29)
+static const uint16_t DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DIST_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+unsigned Deflate(hls::stream<axi_word> &input, hls::stream<axi_word> &output, unsigned format,
+                 unsigned size, unsigned perf[PERF_NUM]);
+void inflate(hls::stream<axi_word> &input, hls::stream<axi_word> &output, unsigned format,
+             unsigned &status, unsigned &size, unsigned perf[PERF_NUM]);
+
+// Combined top level, compresses or decompresses per job, see codec.cpp
+unsigned Codec(hls::stream<axi_word> &input, hls::stream<axi_word> &output, unsigned opcode,
+               unsigned format, unsigned size, unsigned &status, unsigned perf[PERF_NUM]);
+
+// Memory-mapped top level, see deflate_mm.cpp; dst_size is the capacity of dst in bytes
+unsigned Deflate_mm(const stream_data_t *src, stream_data_t *dst, unsigned size, unsigned dst_size,
+                    unsigned format, unsigned perf[PERF_NUM]);
+// Batch top level: runs count jobs of a descriptor ring from index head, see deflate_mm.cpp
+unsigned Deflate_batch(const uint32_t *descriptors, uint32_t *completions, const stream_data_t *mem_in,
+                       stream_data_t *mem_out, unsigned ring_size, unsigned head, unsigned count,
+                       unsigned perf[PERF_NUM]);
+
+int LZ77(hls::stream<axi_word> &input, int size, uint8_t output[LZ77_BUFFER_SIZE], checksum_state &checksum,
+         perf_counters &perf, bool &done_input, bool drain, bool keep_history, unsigned container);
+void LZ77_decoder(hls::stream<uint32_t> &input, hls::stream<axi_word> &output, unsigned format,
+                  unsigned &status, unsigned &size, unsigned perf[PERF_NUM]);
+
+unsigned huffman(uint8_t input[LZ77_BUFFER_SIZE], int input_size, hls::stream<axi_word> &output,
+                 unsigned format, const checksum_state &checksum, perf_counters &perf, bool last);
+void huffman_decoder(hls::stream<axi_word_32> &input, hls::stream<uint32_t> &output, unsigned format);
+void stream_unpack(hls::stream<axi_word> &input, hls::stream<axi_word_32> &output);
+
+// Checksums of the zlib and gzip containers, one stream word per call
+void checksum_init(checksum_state &state);
+void checksum_update(checksum_state &state, stream_data_t word, unsigned valid_bytes);
+#ifdef DEFLATE_NATIVE
+// The same for 'size' bytes at once, for the native build: only the checksum
+// of 'container' (FORMAT_ZLIB: Adler-32, FORMAT_GZIP: CRC-32) is computed
+void checksum_update_bytes(checksum_state &state, const uint8_t *bytes, unsigned size, unsigned container);
+#endif
+uint32_t checksum_crc32(const checksum_state &state);
+uint32_t checksum_adler32(const checksum_state &state);
+
+// Copy the counters of a job to the 'perf' register array
+void perf_export(const perf_counters &counters, unsigned perf[PERF_NUM]);
+
+// Cycle model, C simulation only: fold the iterations of a job into the totals,
+// get or print the totals of all jobs since the last reset, and clear them
+void model_end_job();
+uint64_t model_cycles();
+uint64_t model_report(const char *title, uint64_t bytes);
+void model_reset();
 
 // Below are some helper functions for decoding
-unsigned decoder_get_offset(unsigned &proc_bits_num, uint32_t proc_buffer);
-unsigned dynamic_decoder_get_offset(unsigned &proc_bits_num,
-                                    uint32_t proc_buffer,
-                                    Lookup_Node lookup_table_DIST_1[128]);
+unsigned decoder_get_extra_bits(uint64_t bit_buffer, unsigned pos, unsigned extra_bits_num);
+unsigned decoder_get_offset(unsigned &proc_bits_num, uint64_t bit_buffer, bool is_static,
+                            Lookup_Node lookup_table_DIST_1[64]);
 void permute_CCL(uint3_t CCL[19], CCL_code hTable3[19]);
-void get_huffman_table_1(code_table_node hTable1[286]);
-void get_huffman_table_2(code_table_node hTable2[30]);
-void get_huffman_table_3(CCL_code hTable3[19]);
+// The code tables return the code space left unused: 0 for a complete code,
+// > 0 for an incomplete one, < 0 for an over-subscribed one
+int get_huffman_table_1(code_table_node hTable1[286], unsigned bl_count[16]);
+int get_huffman_table_2(code_table_node hTable2[30], unsigned bl_count[16]);
+int get_huffman_table_3(CCL_code hTable3[19]);
 
 // Function to reverse bits. Use a template for all cases.
+// Only used off the critical path, to build the dynamic lookup tables.
 template <typename T>
 T reverse(T n, unsigned bits_num);
 
-// Function to modify a uint32_t input word to little-endian
-void changeToLittleEndian(uint32_t &next_word);
+// Stream words carry the first byte in bits 31-24. Swapping the bytes gives
+// the LSB-first bit order of the compressed stream, and back. Wiring only.
+inline uint32_t byte_swap(uint32_t word)
+{
+    return (word >> 24) | ((word >> 8) & 0x0000FF00) | ((word << 8) & 0x00FF0000) | (word << 24);
+}
+
+// Byte k (0: the first) of a stream word
+inline uint8_t stream_byte(stream_data_t word, unsigned k)
+{
+    return (uint8_t)(word >> (8 * (STREAM_BYTES - 1 - k)));
+}
+
+// Build an output word of the top-level ports from valid_bytes (0-STREAM_BYTES)
+// starting at the top of 'data'. As AXI4-Stream and the DMA expect, the bytes
+// of a partial word are moved to the low byte lanes, TKEEP = (1 << valid_bytes) - 1.
+inline axi_word make_axi_word(stream_data_t data, unsigned valid_bytes, bool last)
+{
+    const unsigned all_bytes = (1u << STREAM_BYTES) - 1;
+    axi_word word;
+    word.data = valid_bytes == 0 ? (stream_data_t)0 : (stream_data_t)(data >> (8 * (STREAM_BYTES - valid_bytes)));
+    word.keep = all_bytes >> (STREAM_BYTES - valid_bytes);
+    word.strb = word.keep;
+    word.user = 0;
+    word.last = last;
+    word.id = 0;
+    word.dest = 0;
+    return word;
+}
+
+// Valid bytes of an input word, counted from TKEEP
+inline unsigned stream_valid_bytes(const axi_word &word)
+{
+    unsigned valid_bytes = 0;
+    for (int i = 0; i < STREAM_BYTES; i++)
+    {
+#pragma HLS UNROLL
+        valid_bytes += (word.keep >> i) & 0x1;
+    }
+    return valid_bytes;
+}
+
+// The data of an input word with its valid bytes moved back to the top, as
+// stream_byte() reads them; undoes make_axi_word() on a partial word
+inline stream_data_t stream_data(const axi_word &word)
+{
+    unsigned valid_bytes = stream_valid_bytes(word);
+    return valid_bytes == 0 ? (stream_data_t)0 : (stream_data_t)(word.data << (8 * (STREAM_BYTES - valid_bytes)));
+}
+
+// Function to refill the 64-bit bit buffer of the decoder from the input stream
+void refill_bit_buffer(hls::stream<axi_word_32> &input, uint64_t &bit_buffer,
+                       int &buffer_bits_num, bool &done_input);
 
 // Below are functions to build the dynamic Huffman trees on hardware.
 void get_dis_huffman_code(tree_node distance_tree[90], code_table_node dis_codes[30]);
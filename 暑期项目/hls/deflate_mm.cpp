@@ -0,0 +1,236 @@
+/*
+ * File:   deflate_mm.cpp
+ *
+ * Memory-mapped top levels of the Deflate core.
+ */
+
+#include "deflate.h"
+
+/*
+ * Deflate_mm compresses a job straight from memory to memory, without an
+ * external DMA engine in front of the core.
+ *
+ * The host writes the source and destination addresses, the job size and the
+ * destination capacity through the AXI-Lite 'control' bundle and starts the
+ * core. The core reads the source with long m_axi bursts, compresses it with
+ * the same LZ77 and Huffman stages as Deflate(), and writes the compressed
+ * words back with long bursts. It returns the number of compressed bytes.
+ *
+ * The three stages run concurrently (DATAFLOW): the burst read feeds LZ77,
+ * and the burst write drains the encoder while it is running.
+ *
+ * If the compressed job is larger than dst_size bytes, the words past the end
+ * of the destination are dropped and the returned size exceeds dst_size, so
+ * the host can tell. A job must not exceed MAX_JOB_SIZE bytes.
+ *
+ * The 'perf' registers hold the PERF_* counters of the job, as with Deflate().
+ */
+
+// Read the job from memory in bursts, as stream words with TLAST on the last
+static void mm_read(const stream_data_t *src, unsigned size, hls::stream<axi_word> &output)
+{
+    // an empty job still sends one word with TLAST
+    unsigned words = size == 0 ? 1 : (size + STREAM_BYTES - 1) / STREAM_BYTES;
+
+READ_BURST:
+    for (unsigned i = 0; i < words; i++)
+    {
+#pragma HLS PIPELINE II = 1
+#pragma HLS loop_tripcount min = 1 max = 1024
+        stream_data_t data = size == 0 ? (stream_data_t)0 : src[i];
+        unsigned valid_bytes = size - i * STREAM_BYTES;
+        output.write(make_axi_word(data, valid_bytes < STREAM_BYTES ? valid_bytes : STREAM_BYTES, i == words - 1));
+    }
+
+    return;
+}
+
+// Write the compressed words to memory in bursts, up to TLAST; words past dst_words are dropped
+static void mm_write(hls::stream<axi_word> &input, stream_data_t *dst, unsigned dst_words)
+{
+    axi_word word;
+    unsigned i = 0;
+
+WRITE_BURST:
+    do
+    {
+#pragma HLS PIPELINE II = 1
+#pragma HLS loop_tripcount min = 1 max = 1200
+        input.read(word);
+        if (i < dst_words)
+            dst[i] = stream_data(word); // a partial last word is stored from the top
+        i++;
+    } while (!word.last);
+
+    return;
+}
+
+// The compression stage; the size is passed out as the stage has no return value in the dataflow region
+static void deflate_stage(hls::stream<axi_word> &input, hls::stream<axi_word> &output, unsigned format,
+                          unsigned size, unsigned &compressed_size, unsigned perf[PERF_NUM])
+{
+    compressed_size = Deflate(input, output, format, size, perf);
+
+    return;
+}
+
+static void deflate_mm_dataflow(const stream_data_t *src, stream_data_t *dst, unsigned size,
+                                unsigned dst_words, unsigned format, unsigned &compressed_size,
+                                unsigned perf[PERF_NUM])
+{
+#pragma HLS DATAFLOW
+    hls::stream<axi_word> input_words, output_words;
+#pragma HLS STREAM variable = input_words depth = 64
+#pragma HLS STREAM variable = output_words depth = 64
+
+#ifdef DEFLATE_NATIVE
+    // the same stages, on their own threads with DEFLATE_THREADS (native.h)
+    dataflow_run({[&] { mm_read(src, size, input_words); },
+                  [&] { deflate_stage(input_words, output_words, format, size, compressed_size, perf); },
+                  [&] { mm_write(output_words, dst, dst_words); }});
+#else
+    mm_read(src, size, input_words);
+
+    deflate_stage(input_words, output_words, format, size, compressed_size, perf);
+
+    mm_write(output_words, dst, dst_words);
+#endif
+
+    return;
+}
+
+// Top level module for memory-to-memory compression
+unsigned Deflate_mm(const stream_data_t *src,
+                    stream_data_t *dst,
+                    unsigned size,
+                    unsigned dst_size,
+                    unsigned format,
+                    unsigned perf[PERF_NUM])
+{
+#pragma HLS INTERFACE m_axi port=src offset=slave bundle=gmem_in max_read_burst_length=256
+#pragma HLS INTERFACE m_axi port=dst offset=slave bundle=gmem_out max_write_burst_length=256
+#pragma HLS INTERFACE ap_ctrl_chain port=return bundle=control
+#pragma HLS INTERFACE s_axilite port=return bundle=control
+#pragma HLS INTERFACE s_axilite port=src bundle=control
+#pragma HLS INTERFACE s_axilite port=dst bundle=control
+#pragma HLS INTERFACE s_axilite port=size bundle=control
+#pragma HLS INTERFACE s_axilite port=dst_size bundle=control
+#pragma HLS INTERFACE s_axilite port=format bundle=control
+#pragma HLS INTERFACE s_axilite port=perf bundle=control
+
+    unsigned compressed_size;
+
+    if (size > MAX_JOB_SIZE)
+        size = MAX_JOB_SIZE; // keep the buffers safe, the host splits larger data
+
+    deflate_mm_dataflow(src, dst, size, dst_size / STREAM_BYTES, format, compressed_size, perf);
+
+    return compressed_size;
+}
+
+/*
+ * Deflate_batch runs a batch of jobs from a ring of descriptors in memory, so
+ * the host posts many jobs at once instead of starting the core per job.
+ *
+ * Each descriptor holds the source offset, the size, the destination offset
+ * and the flags of a job (DESC_*); the offsets are in bytes from mem_in and
+ * mem_out, which the host points at the same memory. The core runs 'count'
+ * jobs from ring index 'head', wrapping at 'ring_size', and writes the
+ * completion record of each job (compressed size, status) at the same index
+ * of the completion ring. JOB_DONE is set last in the status, so the host can
+ * reap the finished jobs while the batch is still running. The core returns
+ * the number of jobs run, and the 'perf' registers hold the PERF_* counters
+ * summed over the jobs of the batch.
+ */
+
+// Top level module for batches of memory-to-memory compression jobs
+unsigned Deflate_batch(const uint32_t *descriptors,
+                       uint32_t *completions,
+                       const stream_data_t *mem_in,
+                       stream_data_t *mem_out,
+                       unsigned ring_size,
+                       unsigned head,
+                       unsigned count,
+                       unsigned perf[PERF_NUM])
+{
+#pragma HLS INTERFACE m_axi port=descriptors offset=slave bundle=gmem_desc
+#pragma HLS INTERFACE m_axi port=completions offset=slave bundle=gmem_desc
+#pragma HLS INTERFACE m_axi port=mem_in offset=slave bundle=gmem_in max_read_burst_length=256
+#pragma HLS INTERFACE m_axi port=mem_out offset=slave bundle=gmem_out max_write_burst_length=256
+#pragma HLS INTERFACE ap_ctrl_chain port=return bundle=control
+#pragma HLS INTERFACE s_axilite port=return bundle=control
+#pragma HLS INTERFACE s_axilite port=descriptors bundle=control
+#pragma HLS INTERFACE s_axilite port=completions bundle=control
+#pragma HLS INTERFACE s_axilite port=mem_in bundle=control
+#pragma HLS INTERFACE s_axilite port=mem_out bundle=control
+#pragma HLS INTERFACE s_axilite port=ring_size bundle=control
+#pragma HLS INTERFACE s_axilite port=head bundle=control
+#pragma HLS INTERFACE s_axilite port=count bundle=control
+#pragma HLS INTERFACE s_axilite port=perf bundle=control
+
+    unsigned index = head < ring_size ? head : 0;
+    uint32_t descriptor[DESC_WORDS];
+    unsigned job_perf[PERF_NUM], total_perf[PERF_NUM];
+#pragma HLS ARRAY_PARTITION variable = job_perf complete dim = 1
+#pragma HLS ARRAY_PARTITION variable = total_perf complete dim = 1
+
+CLEAR_PERF:
+    for (int i = 0; i < PERF_NUM; i++)
+    {
+#pragma HLS UNROLL
+        total_perf[i] = 0;
+    }
+
+BATCH_LOOP:
+    for (unsigned job = 0; job < count; job++)
+    {
+#pragma HLS loop_tripcount min = 1 max = 1024
+        // fetch the descriptor in one burst
+    READ_DESCRIPTOR:
+        for (int k = 0; k < DESC_WORDS; k++)
+        {
+#pragma HLS PIPELINE II = 1
+            descriptor[k] = descriptors[index * DESC_WORDS + k];
+        }
+
+        unsigned size = descriptor[DESC_SIZE];
+        unsigned format = descriptor[DESC_FLAGS] & (FORMAT_CONTAINER | FORMAT_SYNC_FLUSH);
+        unsigned dst_size = descriptor[DESC_FLAGS] >> 16;
+        unsigned compressed_size = 0;
+        uint32_t status = JOB_DONE;
+
+        if (size > MAX_JOB_SIZE)
+        {
+            status |= JOB_INPUT_TOO_LARGE;
+        }
+        else
+        {
+            deflate_mm_dataflow(mem_in + descriptor[DESC_SRC] / STREAM_BYTES, mem_out + descriptor[DESC_DST] / STREAM_BYTES,
+                                size, dst_size / STREAM_BYTES, format, compressed_size, job_perf);
+            if (compressed_size > dst_size / STREAM_BYTES * STREAM_BYTES)
+                status |= JOB_OUTPUT_OVERFLOW;
+
+        ADD_PERF:
+            for (int i = 0; i < PERF_NUM; i++)
+            {
+#pragma HLS UNROLL
+                total_perf[i] += job_perf[i];
+            }
+        }
+
+        // the size first, the status with JOB_DONE last
+        completions[index * COMPLETION_WORDS] = compressed_size;
+        completions[index * COMPLETION_WORDS + 1] = status;
+
+        index = index == ring_size - 1 ? 0 : index + 1;
+    }
+
+WRITE_PERF:
+    for (int i = 0; i < PERF_NUM; i++)
+    {
+#pragma HLS UNROLL
+        perf[i] = total_perf[i];
+    }
+
+    return count;
+}
@@ -0,0 +1,223 @@
+/*
+ * File:   deflate_mm_test.cpp
+ *
+ * Test bench of the memory-mapped top levels Deflate_mm and Deflate_batch.
+ */
+
+#include "deflate.h"
+
+/*
+ * An array stands in for DDR. The input job is placed at the start of it, and
+ * the core writes the compressed job further on. The test checks that:
+ *
+ * 1. the compressed job inflates back to the input;
+ * 2. nothing is written past the compressed words;
+ * 3. with a destination too small, the core writes only dst_size bytes and
+ *    returns a size larger than dst_size;
+ * 4. a batch of small jobs from a descriptor ring, wrapping around the end of
+ *    the ring, gets one correct completion record per job;
+ * 5. the byte counters match the job sizes, summed over the batch.
+ */
+
+#define DDR_WORDS 16384                           // size of the memory, in stream words
+#define SRC_WORD 0                                // input jobs
+#define DST_WORD 8192                             // compressed jobs
+#define GUARD_PATTERN ((stream_data_t)0xA5A5A5A5) // fills the memory not written by the host
+
+#define RING_SIZE 64   // entries of the descriptor and completion rings
+#define BATCH_HEAD 50  // first descriptor of the batch
+#define BATCH_JOBS 30  // jobs in the batch, wrapping around the end of the ring
+#define BATCH_SLOT 512 // bytes reserved for each job in the input and output areas
+
+static stream_data_t ddr[DDR_WORDS];
+static uint32_t descriptor_ring[RING_SIZE * DESC_WORDS];
+static uint32_t completion_ring[RING_SIZE * COMPLETION_WORDS];
+
+// Store bytes in memory from word 'word', STREAM_BYTES bytes per word, the first at the top
+static void store_bytes(const string &data, unsigned word)
+{
+    for (unsigned i = 0; i < (data.size() + STREAM_BYTES - 1) / STREAM_BYTES; i++)
+    {
+        stream_data_t value = 0;
+        for (int k = 0; k < STREAM_BYTES; k++)
+        {
+            unsigned pos = i * STREAM_BYTES + k;
+            value = (value << 8) | (pos < data.size() ? (uint8_t)data[pos] : 0);
+        }
+        ddr[word + i] = value;
+    }
+}
+
+// Inflate the compressed job at dst_word and compare it with the input
+static bool check_round_trip(const string &input, unsigned dst_word, unsigned compressed_size, unsigned format)
+{
+    hls::stream<axi_word> compressed, decompressed;
+    unsigned words = (compressed_size + STREAM_BYTES - 1) / STREAM_BYTES;
+    unsigned status, output_size;
+    unsigned perf[PERF_NUM];
+    axi_word output_word;
+    string output;
+
+    for (unsigned i = 0; i < words; i++)
+    {
+        unsigned valid_bytes = i == words - 1 ? compressed_size - i * STREAM_BYTES : STREAM_BYTES;
+        compressed.write(make_axi_word(ddr[dst_word + i], valid_bytes, i == words - 1));
+    }
+
+    inflate(compressed, decompressed, format, status, output_size, perf);
+
+    do
+    {
+        decompressed.read(output_word);
+        stream_data_t data = stream_data(output_word);
+        for (int k = 0; k < STREAM_BYTES; k++)
+        {
+            output.push_back(stream_byte(data, k));
+        }
+    } while (!output_word.last);
+    output.resize(input.size());
+
+    return status == INFLATE_OK && output_size == input.size() && output == input &&
+           perf[PERF_BYTES_IN] == compressed_size && perf[PERF_BYTES_OUT] == input.size();
+}
+
+int main(void)
+{
+    string input =
+        "To evaluate our prefetcher we modelled the system using the gem5 simulator [4] in full system mode with the setup "
+        "given in table 2 and the ARMv8 64-bit instruction set. Our applications are derived from existing benchmarks and "
+        "libraries for graph traversal, using a range of graph sizes and characteristics. We simulate the core breadth-first search "
+        "based kernels of each benchmark, skipping the graph construction phase. Our first benchmark is from the Graph 500 community [32]. "
+        "We used their Kronecker graph generator for both the standard Graph 500 search benchmark and a connected components "
+        "calculation. The Graph 500 benchmark is designed to represent data analytics workloads, such as 3D physics "
+        "simulation. Standard inputs are too long to simulate, so we create smaller graphs with scales from 16 to 21 and edge "
+        "factors from 5 to 15 (for comparison, the Graph 500 toy input has scale 26 and edge factor 16).";
+    unsigned size = input.size();
+    unsigned perf[PERF_NUM];
+    bool isFail = false;
+
+    /************************* build memory ***********************************/
+    for (int i = 0; i < DDR_WORDS; i++)
+    {
+        ddr[i] = GUARD_PATTERN;
+    }
+
+    store_bytes(input, SRC_WORD);
+
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+    cout << "input size is " << size << endl;
+
+    /************************* memory to memory compression *******************/
+    unsigned dst_size = (DDR_WORDS - DST_WORD) * STREAM_BYTES;
+    unsigned compressed_size = Deflate_mm(ddr + SRC_WORD, ddr + DST_WORD, size, dst_size, FORMAT_ZLIB, perf);
+    unsigned compressed_words = (compressed_size + STREAM_BYTES - 1) / STREAM_BYTES;
+    cout << "compressed size is " << compressed_size << endl;
+
+    if (perf[PERF_BYTES_IN] != size || perf[PERF_BYTES_OUT] != compressed_size)
+    {
+        isFail = true;
+        cout << "Deflate_mm Fail! Byte counters " << perf[PERF_BYTES_IN] << " / " << perf[PERF_BYTES_OUT] << endl;
+    }
+
+    if (!check_round_trip(input, DST_WORD, compressed_size, FORMAT_ZLIB))
+    {
+        isFail = true;
+        cout << "Deflate_mm Fail! Round trip mismatch." << endl;
+    }
+
+    for (int i = DST_WORD + compressed_words; i < DDR_WORDS; i++)
+    {
+        if (ddr[i] != GUARD_PATTERN)
+        {
+            isFail = true;
+            cout << "Deflate_mm Fail! Write past the job at word " << i << endl;
+            break;
+        }
+    }
+
+    /************************* destination too small **************************/
+    for (int i = DST_WORD; i < DDR_WORDS; i++)
+    {
+        ddr[i] = GUARD_PATTERN;
+    }
+
+    unsigned small_size = 8 * STREAM_BYTES;
+    unsigned truncated_size = Deflate_mm(ddr + SRC_WORD, ddr + DST_WORD, size, small_size, FORMAT_ZLIB, perf);
+
+    if (truncated_size != compressed_size || ddr[DST_WORD + small_size / STREAM_BYTES] != GUARD_PATTERN)
+    {
+        isFail = true;
+        cout << "Deflate_mm Fail! Destination overrun." << endl;
+    }
+
+    /************************* batch of small jobs ****************************/
+    string jobs[BATCH_JOBS];
+    unsigned batch_bytes_in = 0, batch_bytes_out = 0;
+
+    for (int j = 0; j < BATCH_JOBS; j++)
+    {
+        // messages of 40 to 480 bytes, cut from the input
+        unsigned index = (BATCH_HEAD + j) % RING_SIZE;
+        unsigned job_size = 40 + (j * 97) % 441;
+        unsigned src = SRC_WORD * STREAM_BYTES + j * BATCH_SLOT;
+        unsigned dst = DST_WORD * STREAM_BYTES + j * BATCH_SLOT;
+
+        jobs[j] = input.substr((j * 31) % (size - job_size), job_size);
+        store_bytes(jobs[j], src / STREAM_BYTES);
+
+        descriptor_ring[index * DESC_WORDS + DESC_SRC] = src;
+        descriptor_ring[index * DESC_WORDS + DESC_SIZE] = job_size;
+        descriptor_ring[index * DESC_WORDS + DESC_DST] = dst;
+        descriptor_ring[index * DESC_WORDS + DESC_FLAGS] = (BATCH_SLOT << 16) | (j % 3); // raw, zlib and gzip
+        completion_ring[index * COMPLETION_WORDS + 1] = 0;
+    }
+
+    // one job too large, one with an output area too small
+    unsigned large_index = (BATCH_HEAD + 3) % RING_SIZE;
+    unsigned small_index = (BATCH_HEAD + 20) % RING_SIZE;
+    descriptor_ring[large_index * DESC_WORDS + DESC_SIZE] = MAX_JOB_SIZE + 1;
+    descriptor_ring[small_index * DESC_WORDS + DESC_FLAGS] = (STREAM_BYTES << 16) | FORMAT_RAW;
+
+    unsigned jobs_run = Deflate_batch(descriptor_ring, completion_ring, ddr, ddr, RING_SIZE, BATCH_HEAD, BATCH_JOBS, perf);
+
+    for (int j = 0; j < BATCH_JOBS; j++)
+    {
+        unsigned index = (BATCH_HEAD + j) % RING_SIZE;
+        unsigned job_size = completion_ring[index * COMPLETION_WORDS];
+        uint32_t status = completion_ring[index * COMPLETION_WORDS + 1];
+        uint32_t expected = index == large_index ? JOB_DONE | JOB_INPUT_TOO_LARGE : index == small_index ? JOB_DONE | JOB_OUTPUT_OVERFLOW : JOB_DONE;
+        bool jobFail = status != expected;
+
+        if (index != large_index)
+        {
+            batch_bytes_in += jobs[j].size();
+            batch_bytes_out += job_size;
+        }
+
+        if (status == JOB_DONE)
+            jobFail |= !check_round_trip(jobs[j], DST_WORD + j * BATCH_SLOT / STREAM_BYTES, job_size, j % 3);
+        if (jobFail)
+        {
+            isFail = true;
+            cout << "Deflate_batch Fail! Job " << j << " status " << status << endl;
+        }
+    }
+    if (jobs_run != BATCH_JOBS)
+    {
+        isFail = true;
+        cout << "Deflate_batch Fail! " << jobs_run << " jobs run." << endl;
+    }
+    if (perf[PERF_BYTES_IN] != batch_bytes_in || perf[PERF_BYTES_OUT] != batch_bytes_out)
+    {
+        isFail = true;
+        cout << "Deflate_batch Fail! Byte counters " << perf[PERF_BYTES_IN] << " / " << perf[PERF_BYTES_OUT] << endl;
+    }
+
+    if (!isFail)
+    {
+        cout << "Deflate_mm Succeed!" << endl;
+    }
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+
+    return isFail ? 1 : 0;
+}
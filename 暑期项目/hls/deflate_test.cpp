@@ -6,6 +6,7 @@
  */
 
 #include "deflate.h"
+#include <iomanip>
 
 /*
  * The main test bench file for both deflate and inflate core.
@@ -15,15 +16,29 @@
  * to unlimited size. Just not use array for testing.
  */
 
+// Print a stream word in hex, 64 bits at a time: a 128-bit word of the native
+// build has no operator<<
+static void print_word(stream_data_t word)
+{
+    cout << hex << setfill('0');
+    for (int bits = STREAM_WIDTH; bits > 0; bits -= 64)
+    {
+        int part = bits < 64 ? bits : 64;
+        cout << setw(part / 4) << (uint64_t)(word >> (bits - part));
+    }
+    cout << dec << setfill(' ');
+}
+
 int main(void)
 {
 
     uint8_t decoder_output_array[3000], decoding_temp[3000];
     int size = 0;
 
-    hls::stream<uint32_t> input, huffman_encoding_output;
-    hls::stream<uint32_t> decoder_output;
-    uint32_t input_word, output_word;
+    hls::stream<axi_word> input, huffman_encoding_output;
+    hls::stream<axi_word> decoder_output;
+    stream_data_t input_word;
+    axi_word output_word;
 
     /************************* build input ************************************/
     string temp =
@@ -55,13 +70,19 @@ int main(void)
         size++;
     }
 
-    int copy_count = size / 4;
-    copy_count++;
+    int copy_count = (size + STREAM_BYTES - 1) / STREAM_BYTES; // exactly the words of the job, no padding
 
     for (int w = 0; w < copy_count; w++)
     {
-        input_word = (temp[w * 4] << 24) | (temp[w * 4 + 1] << 16) | (temp[w * 4 + 2] << 8) | (temp[w * 4 + 3]);
-        input.write(input_word);
+        // STREAM_BYTES bytes per word, the first at the top; zeros after the job
+        input_word = 0;
+        for (int k = 0; k < STREAM_BYTES; k++)
+        {
+            int pos = w * STREAM_BYTES + k;
+            input_word = (input_word << 8) | (pos < size ? (uint8_t)temp[pos] : 0);
+        }
+        int valid_bytes = size - w * STREAM_BYTES < STREAM_BYTES ? size - w * STREAM_BYTES : STREAM_BYTES;
+        input.write(make_axi_word(input_word, valid_bytes, w == copy_count - 1)); // TLAST ends the job
         //cout << "input " << int(temp[w * 4]) << endl;
         //cout << "input is " << (temp[w * 4] << 24) << endl;
         //cout << "input word is " << input_word << endl;
@@ -73,27 +94,40 @@ int main(void)
 
     /************************* Deflate compression ****************************/
 
-    Deflate(input, huffman_encoding_output);
+    unsigned perf[PERF_NUM];
+    unsigned compressed_size = Deflate(input, huffman_encoding_output, FORMAT_RAW, size, perf);
+    cout << "compressed size is " << compressed_size << endl;
+
+    cout << "bytes in / out: " << perf[PERF_BYTES_IN] << " / " << perf[PERF_BYTES_OUT] << endl;
+    cout << "LZ77 / Huffman cycles: " << perf[PERF_LZ77_CYCLES] << " / " << perf[PERF_HUFFMAN_CYCLES] << endl;
+    cout << "input / output stalls: " << perf[PERF_INPUT_STALLS] << " / " << perf[PERF_OUTPUT_STALLS] << endl;
+    cout << "literals / matches: " << perf[PERF_LITERALS] << " / " << perf[PERF_MATCHES];
+    if (perf[PERF_MATCHES] != 0)
+        cout << " (" << (double)perf[PERF_LITERALS] / perf[PERF_MATCHES] << " literals per match)";
+    cout << endl;
 
     for(int i = 0; i < 10; i++)
     {
-    	cout << "huffman_encoding_output = " << huffman_encoding_output.read() << endl;
+    	cout << "huffman_encoding_output = ";
+    	print_word(huffman_encoding_output.read().data);
+    	cout << endl;
     }
 
-//    inflate(huffman_encoding_output, decoder_output);
-//    // copy stream output to a new array for checking the result
+//    unsigned status, decompressed_size;
+//    inflate(huffman_encoding_output, decoder_output, FORMAT_RAW, status, decompressed_size, perf);
+//    // copy stream output to a new array for checking the result, up to TLAST
 //    i = 0;
-//    while (!decoder_output.empty())
+//    do
 //    {
 //        decoder_output.read(output_word);
-//        decoder_output_array[i * 4] = (output_word & 0xFF000000) >> 24;
-//        decoder_output_array[i * 4 + 1] = (output_word & 0x00FF0000) >> 16;
-//        decoder_output_array[i * 4 + 2] = (output_word & 0x0000FF00) >> 8;
-//        decoder_output_array[i * 4 + 3] = (output_word & 0x000000FF);
+//        for (int k = 0; k < STREAM_BYTES; k++)
+//        {
+//            decoder_output_array[i * STREAM_BYTES + k] = stream_byte(stream_data(output_word), k);
+//        }
 //        i++;
-//    }
-//    decoder_output_array[i * 4] = '\0';
-//    decoder_output_array[i * 4 + 1] = '\0';
+//    } while (!output_word.last);
+//    decoder_output_array[i * STREAM_BYTES] = '\0';
+//    decoder_output_array[i * STREAM_BYTES + 1] = '\0';
 //
 //    /*************************** Compare Results *****************************/
 //    int t = 0;
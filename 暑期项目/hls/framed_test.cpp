@@ -0,0 +1,150 @@
+/*
+ * File:   framed_test.cpp
+ *
+ * Test bench of framed jobs (FORMAT_FRAMED) through the Codec top level.
+ */
+
+#include "stream_io.h"
+#include <vector>
+
+/*
+ * A batch of messages, some empty and some repeating an earlier one, is
+ * compressed as one framed job in each container. Each frame must be the
+ * same bytes as the message compressed as a job of its own (so no match
+ * reaches into an earlier frame) and decompress back to the message. The
+ * size table must match the frames, and the counters the whole job.
+ * Then a batch with a frame over MAX_JOB_SIZE keeps the frames before it and
+ * drops the rest, and a plain job after it runs as usual.
+ */
+
+#define NUM_FRAMES 12
+
+// Append a frame: the prefix word, then the message padded to a word
+static void add_frame(string &batch, const string &message)
+{
+    string prefix(STREAM_BYTES, '\0');
+    for (int k = 0; k < 4; k++)
+        prefix[k] = (char)(message.size() >> (24 - 8 * k));
+    batch += prefix + message;
+    batch.resize((batch.size() + STREAM_BYTES - 1) / STREAM_BYTES * STREAM_BYTES, '\0');
+}
+
+// Entry 'i' of the size table at the end of a framed output
+static unsigned table_entry(const string &output, unsigned entries, unsigned i)
+{
+    unsigned pos = output.size() - entries * 4 + i * 4, value = 0;
+    for (int k = 0; k < 4; k++)
+        value = (value << 8) | (uint8_t)output[pos + k];
+    return value;
+}
+
+// Check the frames of a framed output against the messages, each compressed
+// as a job of its own; false on a mismatch
+static bool check_frames(hls::stream<axi_word> &input, hls::stream<axi_word> &output, const string &compressed,
+                         const vector<string> &messages, unsigned format)
+{
+    unsigned frames = messages.size(), status, perf[PERF_NUM];
+    bool ok = compressed.size() >= 4 && table_entry(compressed, 1, 0) == frames;
+    unsigned pos = 0;
+
+    for (unsigned f = 0; ok && f < frames; f++)
+    {
+        unsigned frame_size = table_entry(compressed, frames + 1, f);
+        string frame = compressed.substr(pos, frame_size);
+        pos += (frame_size + STREAM_BYTES - 1) / STREAM_BYTES * STREAM_BYTES;
+
+        send_job(input, messages[f]);
+        Codec(input, output, OP_DEFLATE, format, messages[f].size(), status, perf);
+        string alone = receive_job(output);
+
+        send_job(input, frame);
+        unsigned size = Codec(input, output, OP_INFLATE, format, 0, status, perf);
+        string decompressed = receive_job(output);
+
+        ok = frame == alone && status == INFLATE_OK && size == messages[f].size() && decompressed == messages[f];
+        if (!ok)
+            cout << "frame " << f << " Fail! " << frame_size << " bytes, status " << status << endl;
+    }
+
+    return ok && pos + (frames + 1) * 4 == compressed.size();
+}
+
+int main(void)
+{
+    string text =
+        "Our prefetcher is most easily incorporated into libraries that implement graph traversal for CSR graphs. To this "
+        "end, we use the Boost Graph Library (BGL) [41], a C++ templated library supporting many graph-based algorithms "
+        "and graph data structures. To support our prefetcher, we added configuration instructions on constructors for CSR "
+        "data structures, circular buffer queues (serving as the work list) and colour vectors (serving as the visited list).";
+
+    hls::stream<axi_word> input, output;
+    unsigned status, perf[PERF_NUM];
+    bool isFail = false;
+
+    // messages of 0 to ~200 bytes, every fourth one the same as the one before
+    vector<string> messages;
+    string batch;
+    for (int f = 0; f < NUM_FRAMES; f++)
+    {
+        string message = f % 5 == 0 ? string() : f % 4 == 3 ? messages.back() : text.substr(f * 29, f * 17 + 3);
+        messages.push_back(message);
+        add_frame(batch, message);
+    }
+
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+
+    for (unsigned format = FORMAT_RAW; format <= FORMAT_GZIP; format++)
+    {
+        send_job(input, batch);
+        unsigned compressed_size = Codec(input, output, OP_DEFLATE, format | FORMAT_FRAMED, batch.size(), status, perf);
+        string compressed = receive_job(output);
+
+        cout << "format " << format << ": " << NUM_FRAMES << " frames, " << batch.size() << " -> " << compressed_size
+             << " bytes" << endl;
+        if (compressed.size() != compressed_size || perf[PERF_BYTES_IN] != batch.size() ||
+            perf[PERF_BYTES_OUT] != compressed_size || !check_frames(input, output, compressed, messages, format))
+        {
+            isFail = true;
+            cout << "Framed Fail! Format " << format << endl;
+        }
+    }
+
+    // a frame over MAX_JOB_SIZE: the two frames before it are kept
+    string long_batch;
+    add_frame(long_batch, messages[1]);
+    add_frame(long_batch, messages[2]);
+    long_batch += string(STREAM_BYTES, '\0');
+    long_batch[long_batch.size() - STREAM_BYTES] = (char)0x7F;
+    long_batch += text;
+    add_frame(long_batch, messages[3]);
+
+    send_job(input, long_batch);
+    unsigned compressed_size = Codec(input, output, OP_DEFLATE, FORMAT_ZLIB | FORMAT_FRAMED, long_batch.size(), status, perf);
+    string compressed = receive_job(output);
+    vector<string> kept(messages.begin() + 1, messages.begin() + 3);
+    if (compressed.size() != compressed_size || !input.empty() || !check_frames(input, output, compressed, kept, FORMAT_ZLIB))
+    {
+        isFail = true;
+        cout << "Framed Fail! Frame over MAX_JOB_SIZE." << endl;
+    }
+
+    // a plain job after the framed ones
+    send_job(input, text);
+    compressed_size = Codec(input, output, OP_DEFLATE, FORMAT_GZIP, text.size(), status, perf);
+    compressed = receive_job(output);
+    send_job(input, compressed);
+    unsigned decompressed_size = Codec(input, output, OP_INFLATE, FORMAT_GZIP, 0, status, perf);
+    if (receive_job(output) != text || decompressed_size != text.size() || status != INFLATE_OK)
+    {
+        isFail = true;
+        cout << "Framed Fail! Plain job after the batches." << endl;
+    }
+
+    if (!isFail)
+    {
+        cout << "Framed Succeed!" << endl;
+    }
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+
+    return isFail ? 1 : 0;
+}
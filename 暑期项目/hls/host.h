@@ -0,0 +1,236 @@
+/*
+ * File:   host.h
+ *
+ * Host side of the cores, in the native build: parallel compression and
+ * decompression, and the runtime of a Codec instance behind DMA channels.
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+#include "deflate.h"
+#include <vector>
+#include <functional>
+#include <memory>
+#include <atomic>
+
+#ifndef DEFLATE_NATIVE
+#error "host.h needs the native build: -DDEFLATE_NATIVE -pthread"
+#endif
+
+/*
+ * The host code runs the cores as a library, see native.h:
+ *
+ *     g++ -O3 -Wno-unknown-pragmas -DDEFLATE_NATIVE -pthread -c deflate.cpp inflate.cpp checksum.cpp codec.cpp parallel.cpp runtime.cpp
+ *
+ * The state the cores keep from job to job is per thread (CORE_STATE), so
+ * each host thread can run a core of its own.
+ */
+
+// Bound of the compressed bytes of one job: at most 9 bits per byte with the
+// static codes, plus the header, the block header and the sync flush or trailer
+#define JOB_OUTPUT_BOUND (MAX_JOB_SIZE * 9 / 8 + 32)
+
+// A worker compresses one job of up to MAX_JOB_SIZE bytes in 'format' into
+// 'out', JOB_OUTPUT_BOUND bytes, and returns the compressed bytes
+typedef std::function<unsigned(const uint8_t *data, unsigned size, unsigned format, uint8_t *out)> chunk_worker;
+
+// The Deflate core on a CPU core, in the calling thread
+chunk_worker cpu_worker();
+// Software stand-in of one accelerator instance, through the Codec top level
+chunk_worker accelerator_stand_in();
+// 'cpus' CPU workers (0: one per CPU core) and 'accelerators' accelerator stand-ins
+std::vector<chunk_worker> make_workers(unsigned cpus, unsigned accelerators);
+
+// Flag of parallel_deflate, not sent to the cores: append the block index to
+// a gzip stream, in an empty gzip member (see parallel.cpp)
+#define FORMAT_BLOCK_INDEX 0x10
+
+// Where the independent jobs of a parallel stream are
+struct block_index
+{
+    unsigned job_size;           // uncompressed bytes of each job, the last one may be shorter
+    size_t data_size;            // uncompressed bytes of the stream
+    std::vector<size_t> offsets; // byte offset of the output of each job, the first one with the header
+    size_t end;                  // byte offset of the last block, after the jobs
+};
+
+// Compress 'size' bytes into one stream of 'format' (FORMAT_RAW/ZLIB/GZIP,
+// FORMAT_BLOCK_INDEX), in jobs of MAX_JOB_SIZE bytes spread over the workers,
+// one thread each. With 'index', also get where the jobs are in the stream.
+std::vector<uint8_t> parallel_deflate(const uint8_t *data, size_t size, unsigned format,
+                                      const std::vector<chunk_worker> &workers, block_index *index = NULL);
+
+// Read the block index of a gzip stream from its last member; false if there is none
+bool read_block_index(const uint8_t *stream, size_t size, block_index &index);
+
+// The block index as a file of its own, for any container
+std::vector<uint8_t> save_block_index(const block_index &index);
+bool load_block_index(const uint8_t *bytes, size_t size, block_index &index);
+
+// Decompress a stream of parallel_deflate in 'format' (FORMAT_RAW/ZLIB/GZIP):
+// the jobs of 'index' are inflated at once on 'threads' threads (0: one per
+// CPU core), then the trailer is checked. status: INFLATE_OK or INFLATE_* errors ORed.
+std::vector<uint8_t> parallel_inflate(const uint8_t *stream, size_t size, unsigned format,
+                                      const block_index &index, unsigned threads, unsigned &status);
+
+// Decompress the bytes offset to offset + length - 1 of a stream of
+// parallel_deflate: only the jobs that hold them are inflated, on 'threads'
+// threads. The trailer is not checked, as the rest of the data is not
+// decompressed. status: INFLATE_OK or INFLATE_* errors ORed.
+std::vector<uint8_t> inflate_range(const uint8_t *stream, size_t size, unsigned format, const block_index &index,
+                                   size_t offset, size_t length, unsigned threads, unsigned &status);
+
+/*
+ * A Codec instance with its AXI DMA engine: the send channel (MM2S) feeds
+ * the input stream from a buffer, the receive channel (S2MM) writes the
+ * output stream to another, as in jupyter_test.ipynb. The buffers are
+ * STREAM_BYTES words, the first byte at the top of a word.
+ */
+class codec_device
+{
+  public:
+    virtual ~codec_device() {}
+    // Load the registers, start the receive channel into 'dst' (up to
+    // dst_words) and the send channel from 'src' ('size' bytes), and return
+    // at once. The device may run the job while the one before it is still
+    // running; the jobs complete in order.
+    virtual void start(unsigned opcode, unsigned format, const stream_data_t *src, unsigned size, stream_data_t *dst,
+                       unsigned dst_words) = 0;
+    // Retire the oldest started job if it is complete, waiting for it with
+    // 'wait': the bytes Codec returned and its status and counters. False if
+    // it is still running.
+    virtual bool finish(bool wait, unsigned &size, unsigned &status, unsigned perf[PERF_NUM]) = 0;
+};
+
+// A device in software: the send channel, Codec and the receive channel run
+// on three threads, each on its own job. With 'dma_bytes_per_second', each
+// channel also takes the time of its transfer, without using the CPU; with
+// 'job_setup_seconds', the send channel takes that long to start each job
+// (registers, descriptors and the interrupt of the last job).
+std::unique_ptr<codec_device> make_simulated_device(double dma_bytes_per_second = 0, double job_setup_seconds = 0);
+
+/*
+ * Arena of DMA buffers, allocated once as one block (one contiguous memory
+ * allocation, as a cma_array) and cut into buffers of ARENA_CLASSES sizes.
+ * acquire() and release() are lock-free, from any thread. The buffers are
+ * STREAM_BYTES words, the first byte at the top of a word, so the caller can
+ * fill an input and read an output in place with set_buffer_byte() and
+ * buffer_byte(). See runtime.cpp.
+ */
+#define ARENA_CLASSES 3
+// bytes of the buffers of each class: small messages, batches, a whole job output
+static const unsigned ARENA_CLASS_BYTES[ARENA_CLASSES] = {
+    256, 1024, (JOB_OUTPUT_BOUND + STREAM_BYTES - 1) / STREAM_BYTES * STREAM_BYTES};
+
+struct arena_buffer
+{
+    stream_data_t *words;       // in the arena block
+    unsigned capacity;          // bytes, ARENA_CLASS_BYTES of the class
+    unsigned size_class;
+    std::atomic<uint32_t> next; // the next free buffer of the class, plus 1; 0: none
+};
+
+class buffer_arena
+{
+  public:
+    // counts[c] buffers of class c
+    explicit buffer_arena(const unsigned counts[ARENA_CLASSES]);
+
+    // A free buffer of at least 'bytes', from the smallest class with one;
+    // NULL if there is none
+    arena_buffer *acquire(unsigned bytes);
+    void release(arena_buffer *buffer);
+
+  private:
+    buffer_arena(const buffer_arena &);
+    buffer_arena &operator=(const buffer_arena &);
+
+    bool pop(unsigned size_class, arena_buffer *&buffer);
+
+    std::vector<stream_data_t> block;
+    std::unique_ptr<arena_buffer[]> buffers;
+    // top of the free list of each class: a tag, changed by each update, in
+    // the high 32 bits, so a pop does not take a list that changed in between
+    std::atomic<uint64_t> free_lists[ARENA_CLASSES];
+};
+
+// Byte 'pos' of a buffer
+inline uint8_t buffer_byte(const arena_buffer &buffer, unsigned pos)
+{
+    return stream_byte(buffer.words[pos / STREAM_BYTES], pos % STREAM_BYTES);
+}
+
+inline void set_buffer_byte(arena_buffer &buffer, unsigned pos, uint8_t value)
+{
+    unsigned shift = 8 * (STREAM_BYTES - 1 - pos % STREAM_BYTES);
+    stream_data_t &word = buffer.words[pos / STREAM_BYTES];
+    word = (word & ~((stream_data_t)0xFF << shift)) | ((stream_data_t)value << shift);
+}
+
+/*
+ * Runtime of jobs on a device, for one host thread. It takes the buffers of
+ * each job from an arena, and keeps up to 'depth' jobs started on the device,
+ * so that with two the device sends job N + 1 while it receives job N
+ * (double buffering). Nothing is allocated per job. See runtime.cpp.
+ */
+class codec_runtime
+{
+  public:
+    codec_runtime(codec_device &device, buffer_arena &arena, unsigned depth = 2);
+
+    // Copy a job of up to MAX_JOB_SIZE bytes into a buffer of the arena and
+    // start it (OP_DEFLATE/OP_INFLATE, FORMAT_*), with its ticket. False if
+    // 'depth' jobs are in flight, or the arena is out of buffers: poll one first.
+    bool submit(unsigned opcode, unsigned format, const uint8_t *data, unsigned size, unsigned &ticket);
+    // The same for a job already in a buffer of the arena; the runtime
+    // releases it once the job is polled. The caller keeps it on false.
+    bool submit(unsigned opcode, unsigned format, arena_buffer *input, unsigned size, unsigned &ticket);
+    // If job 'ticket' is complete, copy its output to 'out', JOB_OUTPUT_BOUND
+    // bytes, and free its buffers. size: the bytes Codec returned; status:
+    // INFLATE_* or CODEC_OPCODE_ERROR. With 'wait', wait for it. False if it
+    // is not complete, or there is no such job.
+    bool poll(unsigned ticket, uint8_t *out, unsigned &size, unsigned &status, bool wait = false);
+    // The same, handing over the output buffer itself; the caller releases it to the arena
+    bool poll(unsigned ticket, arena_buffer *&output, unsigned &size, unsigned &status, bool wait = false);
+
+    // Jobs submitted and not polled yet
+    unsigned in_flight() const { return submitted; }
+
+  private:
+    enum slot_state
+    {
+        SLOT_FREE,
+        SLOT_RUNNING,
+        SLOT_DONE
+    };
+
+    struct slot
+    {
+        slot_state state;
+        unsigned ticket;
+        arena_buffer *src, *dst; // the DMA buffers
+        unsigned size, status;
+    };
+
+    bool retire(bool wait);
+    slot *find(unsigned ticket, bool wait);
+
+    codec_device &device;
+    buffer_arena &arena;
+    std::vector<slot> slots;
+    std::vector<unsigned> running; // slots started on the device, oldest first
+    unsigned next_ticket;
+    unsigned submitted;
+};
+
+// Pack messages[first], messages[first + 1], ... into one framed job
+// (OP_DEFLATE with FORMAT_FRAMED), as many as fit the input and the output
+// buffer of a job; returns how many. 0: messages[first] does not fit a batch,
+// send it as a job of its own. See runtime.cpp.
+size_t pack_frames(const std::vector<std::vector<uint8_t>> &messages, size_t first, std::vector<uint8_t> &job);
+// Split the output of a framed job into the streams of its frames; false if
+// the size table does not match the output
+bool unpack_frames(const uint8_t *output, size_t size, std::vector<std::vector<uint8_t>> &frames);
+
+#endif /* HOST_H */
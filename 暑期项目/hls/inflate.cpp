@@ -12,800 +12,835 @@
  */
 
 // Top level module for decompression
-void inflate(hls::stream<uint32_t> &input, hls::stream<uint32_t> &output)
+// format: FORMAT_RAW/ZLIB/GZIP; status: INFLATE_OK or INFLATE_* errors ORed; size: decompressed bytes
+// perf: PERF_* counters of the job
+void inflate(hls::stream<axi_word> &input, hls::stream<axi_word> &output, unsigned format,
+             unsigned &status, unsigned &size, unsigned perf[PERF_NUM])
 {
-
-    uint8_t huffman_decoding_output[3000];
-
-    // The two decoders can be combined together to make the max input size to
-    // unlimited. But separating them makes debugging easier.
-    huffman_decoder(input, huffman_decoding_output);
-
-    LZ77_decoder(huffman_decoding_output, output);
+#pragma HLS INTERFACE ap_ctrl_chain port=return bundle=control
+#pragma HLS INTERFACE axis register both port=output
+#pragma HLS INTERFACE axis register both port=input
+#pragma HLS INTERFACE s_axilite port=format bundle=control
+#pragma HLS INTERFACE s_axilite port=status bundle=control
+#pragma HLS INTERFACE s_axilite port=size bundle=control
+#pragma HLS INTERFACE s_axilite port=perf bundle=control
+#pragma HLS DATAFLOW
+
+    // 32-bit words of the compressed stream for the Huffman decoder
+    hls::stream<axi_word_32> unpacked_input;
+#pragma HLS STREAM variable = unpacked_input depth = 4
+
+    // LZ77 tokens from the Huffman decoder. The two decoders run concurrently,
+    // so the LZ77 decoder copies the matches of one block while the Huffman
+    // decoder is parsing the header and building the tables of the next block.
+    hls::stream<uint32_t> huffman_decoding_output;
+#pragma HLS STREAM variable = huffman_decoding_output depth = 64
+
+#ifdef DEFLATE_NATIVE
+    // the same stages, on their own threads with DEFLATE_THREADS (native.h)
+    dataflow_run({[&] { stream_unpack(input, unpacked_input); },
+                  [&] { huffman_decoder(unpacked_input, huffman_decoding_output, format); },
+                  [&] { LZ77_decoder(huffman_decoding_output, output, format, status, size, perf); }});
+#else
+    stream_unpack(input, unpacked_input);
+
+    huffman_decoder(unpacked_input, huffman_decoding_output, format);
+
+    LZ77_decoder(huffman_decoding_output, output, format, status, size, perf);
+#endif
 
     return;
 }
 
 /*
  * See the comment in deflate.cpp for the endianness clarification.
+ *
+ * The decoder handles any number of stored, static and dynamic blocks until
+ * the block with BFINAL set. The tables of a dynamic block are built before
+ * its data is decoded, in the same loop; the LZ77 decoder, a stage of its
+ * own, copies the matches of the previous block meanwhile. The header of a
+ * block starts right after the end-of-block code of the previous one, so it
+ * cannot be parsed, nor the tables built, while that block is decoded.
+ *
+ * The lookup tables are not cleared between blocks: a complete code writes
+ * every entry. Only an incomplete code (a single code, or no distance code)
+ * clears its table first, so its unused entries decode to LOOKUP_NO_CODE.
+ *
+ * For zlib and gzip, the header is checked and skipped before the first
+ * block. The trailer is passed to LZ77_decoder behind TOKEN_END, because
+ * the checksums are computed over the decompressed data there. A stream with
+ * a data error, including one cut before the end of its trailer, passes no
+ * trailer, and its checksums are not checked.
+ *
+ * The compressed job ends at the input word with TLAST. Words after the end
+ * of the stream are read up to TLAST and dropped, so the next job starts
+ * cleanly. The decompressed job ends with TLAST on the output.
+ *
+ * The Huffman decoder takes at most 32 bits per step, so a wide input word
+ * (STREAM_WIDTH 64 or 128) is split into 32-bit words by stream_unpack(),
+ * which runs as its own stage. LZ77_decoder packs the output into words of
+ * STREAM_BYTES bytes.
+ *
+ * The counters of each stage are passed down behind the data, like the
+ * trailer, so that LZ77_decoder alone writes the 'perf' registers.
  */
 
-void huffman_decoder(hls::stream<uint32_t> &input, uint8_t decoding_output[3000])
+// Split each input word into 32-bit words, first byte first. Only the 32-bit
+// words holding valid bytes of the last word are passed on, the last with TLAST
+// and the TKEEP of its valid bytes, so the decoder knows where the input ends.
+// Two more words follow the job: the input bytes and the input stalls.
+void stream_unpack(hls::stream<axi_word> &input, hls::stream<axi_word_32> &output)
 {
+    axi_word input_word;
+    axi_word_32 output_word;
+    unsigned lanes = STREAM_WIDTH / 32;
+    unsigned lane = 0;
+    unsigned valid_bytes = STREAM_BYTES; // of the current input word
+    uint32_t bytes_in = 0, input_stalls = 0;
+
+    output_word.keep = 0xF;
+    output_word.strb = 0xF;
+    output_word.user = 0;
+    output_word.id = 0;
+    output_word.dest = 0;
+
+UNPACK_LOOP:
+    while (true)
+    {
+#pragma HLS PIPELINE II = 1
+        MODEL_ITERATION(MODEL_UNPACK_LOOP);
+        if (lane == 0)
+        {
+            if (input.empty())
+                input_stalls++; // the read below waits for the input
+            input.read(input_word);
+            lanes = STREAM_WIDTH / 32;
+            valid_bytes = STREAM_BYTES;
+            bytes_in += STREAM_BYTES;
+            if (input_word.last)
+            {
+                // TKEEP marks the valid bytes in the low lanes, they are moved
+                // back to the top; at least one lane is passed on
+                valid_bytes = stream_valid_bytes(input_word);
+                input_word.data = stream_data(input_word);
+                lanes = valid_bytes <= 4 ? 1 : (valid_bytes + 3) / 4;
+                bytes_in += valid_bytes - STREAM_BYTES;
+            }
+        }
 
-    int output_pos = 0;
-
-    uint32_t proc_buffer; // main buffer storing the data to be processed
-    int buffer_bits_num;  // the number of bits in the current buffer
-    uint32_t next_word;   // the next word to be stored into the buffer, used for reading from hls_stream
-    int next_word_bits;   // the number of valid bits in the next word buffer
-
-    unsigned proc_bits_num; // the number of bits were processed in this iteration
-
-    bool done_decoding = false;
-    bool done_input = false;
-
-    uint8_t copy_8_bits;
-    uint16_t copy_16_bits;
-    uint3_t block_header;
+        output_word.data = (uint32_t)(input_word.data >> (STREAM_WIDTH - 32 * (lane + 1)));
+        output_word.last = input_word.last && lane == lanes - 1;
+        output_word.keep = output_word.last ? (1 << (valid_bytes - 4 * lane)) - 1 : 0xF;
+        output.write(output_word);
 
-    unsigned length; // the length after decoding
-    unsigned offset; // the offset corresponding to the previous length;
+        if (output_word.last)
+            break;
+        lane = lane == lanes - 1 ? 0 : lane + 1;
+    }
 
-    // change input to little-endian
-    input.read(next_word);
-    changeToLittleEndian(next_word);
+    // the counters of this stage
+    output_word.last = false;
+    output_word.keep = 0xF;
+    output_word.data = bytes_in;
+    output.write(output_word);
+    output_word.data = input_stalls;
+    output.write(output_word);
 
-    proc_buffer = next_word;
-    block_header = (proc_buffer & 0xE0000000) >> 29;
+    return;
+}
 
-    input.read(next_word);
-    changeToLittleEndian(next_word);
-    next_word_bits = 32;
+// Skip a zero-terminated string of the gzip header (FNAME, FCOMMENT)
+static void decoder_skip_string(hls::stream<axi_word_32> &input, uint64_t &bit_buffer,
+                                int &buffer_bits_num, bool &done_input)
+{
+    bool done_string = false;
 
-    if (block_header >= 0 && block_header <= 2)
-    {
-        // not the last block
-        // currently, not consider this situation
-        // can modify code easily to achieve this functionality
-    }
-    else if (block_header == 4)
-    {
-        // last block, no compression
-        // currently, not consider this situation
-        // just copy the literals directly (following the standard)
-    }
-    else if (block_header == 6)
+SKIP_STRING:
+    while (!done_string)
     {
-        // last block, static Huffman encoding
+#pragma HLS PIPELINE II = 1
+        refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
 
-        proc_buffer <<= 3;
-        buffer_bits_num = 29;
+        if (buffer_bits_num < 8)
+            break; // truncated, caught by the block loop
 
-    STATIC_MAIN_LOOP:
-        while (buffer_bits_num > 0 && !done_decoding)
-        {
-            // the processing buffer is not empty, still need to decode
-
-        STATIC_INPUT:
-            while (buffer_bits_num < 24 && !done_input)
-            {
-                // shift input into the processing buffer, if the buffer is too short
-                // use a loop, not if statement. otherwise, the input process would be wrong!
-                // Well, quite complex logic
-
-                proc_buffer |= (next_word >> buffer_bits_num);
+        done_string = (bit_buffer & 0xFF) == 0;
+        bit_buffer >>= 8;
+        buffer_bits_num -= 8;
+    }
 
-                if ((32 - buffer_bits_num) <= next_word_bits)
-                {
-                    // fill the entire buffer
-                    next_word <<= (32 - buffer_bits_num);
-                    next_word_bits -= (32 - buffer_bits_num);
-                    buffer_bits_num = 32;
-                }
-                else
-                {
-                    // not fill the entire buffer, read the input stream
-                    buffer_bits_num += next_word_bits;
-                    next_word_bits = 0;
-                }
+    return;
+}
 
-                if (next_word_bits == 0)
-                {
-                    if (!input.empty())
-                    {
-                        input.read(next_word);
-                        changeToLittleEndian(next_word);
-                        next_word_bits = 32;
-                    }
-                    else
-                    {
-                        // the input stream is empty
-                        done_input = true;
-                    }
-                }
-            }
+// Check and skip the zlib or gzip header in front of the first block
+static unsigned decoder_skip_header(hls::stream<axi_word_32> &input, uint64_t &bit_buffer,
+                                    int &buffer_bits_num, bool &done_input, unsigned format)
+{
+    unsigned errors = INFLATE_OK;
 
-            // try to match the first 8/9 bits of buffer to the literal table
-            copy_8_bits = (proc_buffer & 0xFF000000) >> 24;
-            if (copy_8_bits >= 0x30 && copy_8_bits <= 0x0BF)
-            {
-                // edoc: 0-143, literals
-                decoding_output[output_pos++] = copy_8_bits - 0x30;
-                proc_bits_num = 8;
-            }
-            else if (copy_8_bits >= 0x0C0 && copy_8_bits <= 0x0C7)
-            {
-                // edoc: 280-287
-                // Currently impossible go into this position
-                cout << "Wrong! Length is " << copy_8_bits << endl;
-            }
-            else
-            {
-                copy_8_bits = (proc_buffer >> 25) & 0x7F;
-                if (copy_8_bits == 0x0)
-                {
-                    // reach the last edoc (256), stop decoding
-                    proc_bits_num = 7;
-                    done_decoding = true;
-                }
-                else if (copy_8_bits > 0x0 && copy_8_bits <= 0x17)
-                {
-                    // edoc: 257-279, length
+    refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
 
-                    // calculate the length given the code
-                    if (copy_8_bits >= 0x1 && copy_8_bits <= 0x08)
-                    {
-                        // 257-264
-                        length = copy_8_bits + 2;
-                        proc_bits_num = 7;
-                    }
-                    else if (copy_8_bits >= 0x09 && copy_8_bits <= 0x0C)
-                    {
-                        // 265-268
-                        length = copy_8_bits * 2 - 7 + ((proc_buffer & 0x01000000) >> 24);
-                        proc_bits_num = 8;
-                    }
-                    else if (copy_8_bits >= 0x0D && copy_8_bits <= 0x10)
-                    {
-                        // 269-272
-                        length = copy_8_bits * 4 - 33 + ((proc_buffer & 0x01800000) >> 23);
-                        proc_bits_num = 9;
-                    }
-                    else if (copy_8_bits >= 0x11 && copy_8_bits <= 0x14)
-                    {
-                        // 273-276
-                        length = copy_8_bits * 8 - 101 + ((proc_buffer & 0x01C00000) >> 22);
-                        proc_bits_num = 10;
-                    }
-                    else
-                    {
-                        // 277-279
-                        // Currently impossible to enter here
-                        cout << "Wrong! Length is " << copy_8_bits << endl;
-                    }
+    if (format == FORMAT_ZLIB)
+    {
+        // CMF, FLG: deflate, window up to 32K, FCHECK, no preset dictionary
+        unsigned CMF = bit_buffer & 0xFF;
+        unsigned FLG = (bit_buffer >> 8) & 0xFF;
 
-                    // get the corresponding offset
-                    offset = decoder_get_offset(proc_bits_num, proc_buffer);
-
-                    // write the results to decoding output
-                    decoding_output[output_pos] = '@';
-                    decoding_output[output_pos + 1] = offset >> 7;
-                    decoding_output[output_pos + 2] = (offset & 0x07F);
-                    decoding_output[output_pos + 3] = length;
-                    output_pos += 4;
-                }
-                else
-                {
-                    copy_16_bits = (proc_buffer & 0xFF800000) >> 23;
-                    if (copy_16_bits >= 0x190 && copy_16_bits <= 0x1FF)
-                    {
-                        // edoc: 144-255, special literals
-                        decoding_output[output_pos++] = copy_16_bits - 0x190 + 144;
-                        proc_bits_num = 9;
-                    }
-                    else
-                    {
-                        cout << "Wrong! Cannot decode!" << endl;
-                    }
-                }
-            }
+        if ((CMF & 0xF) != 8 || (CMF >> 4) > 7 || (CMF * 256 + FLG) % 31 != 0 || (FLG & 0x20))
+            errors |= INFLATE_HEADER_ERROR;
 
-            // modify the proc_buffer
-            proc_buffer <<= proc_bits_num;
-            buffer_bits_num -= proc_bits_num;
-            proc_bits_num = 0;
-        }
+        bit_buffer >>= 16;
+        buffer_bits_num -= 16;
     }
-    else if (block_header == 5)
+    else if (format == FORMAT_GZIP)
     {
-        // last block, dynamic Huffman encoding
+        // ID1, ID2, CM = deflate, FLG without reserved bits
+        unsigned FLG = (bit_buffer >> 24) & 0xFF;
 
-        uint5_t HLIT, HDIST;
-        uint4_t HCLEN;
-        uint3_t CCL[19];
-#pragma HLS ARRAY_PARTITION variable = CCL complete dim = 1
+        if ((bit_buffer & 0xFFFFFF) != 0x088B1F || (FLG & 0xE0))
+            errors |= INFLATE_HEADER_ERROR;
 
-        code_table_node hTable1[286];
-        // Huffman Table 1 for literals and lengths
-        code_table_node hTable2[30];
-        // Huffman Table 2 for distances
-        CCL_code hTable3[19];
-        // Huffman Table 3
-
-        Lookup_Node lookup_table_CCL[128];
-        // 7 bits table for CL1/2 decoding -> should be 0~127
-        Lookup_Node lookup_table_LIT_1[512];
-        // 9 bits table for first level lookup of LIT
-        Lookup_Node lookup_table_DIST_1[64];
-        // 6 bits table for first level lookup of DIST
-
-        HLIT = (proc_buffer & 0x1F000000) >> 24;
-        HDIST = (proc_buffer & 0x00F80000) >> 19;
-        HCLEN = (proc_buffer & 0x00078000) >> 15;
-
-        // Add Little-Endian Modification Here - swap bits in HLIT, HDIST, HCLEN
-        HLIT = reverse(HLIT, 5);
-        HDIST = reverse(HDIST, 5);
-        HCLEN = reverse(HCLEN, 4);
-
-        // Get CCL codes
-        proc_buffer <<= 17;
-        buffer_bits_num = 15;
-        int CCL_index = 0;
-    GET_CCL:
-        for (; CCL_index < (HCLEN + 4); CCL_index++)
-        {
-#pragma HLS PIPELINE
+        bit_buffer >>= 32;
+        buffer_bits_num -= 32;
 
-            if (buffer_bits_num == 2)
-            {
-                // currently, got 15 CCLs, trying to get the 16th CCL, but no enough bits in buffer
-                proc_buffer |= (next_word >> 2);
-                buffer_bits_num = 32;
-                next_word <<= 30;
-                next_word_bits = 2;
-            }
-
-            CCL[CCL_index] = (proc_buffer & 0xE0000000) >> 29;
+        // MTIME, XFL, OS
+        refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
+        bit_buffer >>= 32;
+        buffer_bits_num -= 32;
+        refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
+        bit_buffer >>= 16;
+        buffer_bits_num -= 16;
 
-            // Add Little-Endian Modification Here - swap each CCL code
-            CCL[CCL_index] = reverse(CCL[CCL_index], 3);
-
-            proc_buffer <<= 3;
-            buffer_bits_num -= 3;
-
-            if (buffer_bits_num == 0)
+        if (FLG & 0x04)
+        {
+            // FEXTRA: XLEN, then XLEN bytes
+            refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
+            unsigned extra_length = bit_buffer & 0xFFFF;
+            bit_buffer >>= 16;
+            buffer_bits_num -= 16;
+
+        SKIP_EXTRA:
+            for (unsigned i = 0; i < extra_length; i++)
             {
-                proc_buffer = next_word;
-                buffer_bits_num = 32;
-                input.read(next_word);
-                changeToLittleEndian(next_word);
+#pragma HLS PIPELINE II = 1
+#pragma HLS loop_tripcount min = 0 max = 65535
+                refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
+                bit_buffer >>= 8;
+                buffer_bits_num -= 8;
             }
         }
-    FILL_REMAINING_CCL:
-        for (; CCL_index < 19; CCL_index++)
+        if (FLG & 0x08)
         {
-#pragma HLS UNROLL
-            // fill in remaining CCL array
-            CCL[CCL_index] = 0;
+            // FNAME
+            decoder_skip_string(input, bit_buffer, buffer_bits_num, done_input);
         }
-        permute_CCL(CCL, hTable3);    // permute the CCL code
-        get_huffman_table_3(hTable3); // generate the Huffman table 3
-
-        // Build the lookup table for Huffman table 3
-    BUILD_LOOKUP_TABLE_3:
-        for (int i = 0; i < 19; i++)
+        if (FLG & 0x10)
         {
-#pragma HLS UNROLL
-            // for each CCL
-            if (hTable3[i].length != 0)
-            {
-                unsigned len = hTable3[i].length;
-                unsigned start_pos = hTable3[i].code << (7 - len);
-                unsigned repeat_times = (1 << (7 - len));
-
-            BUILD_LOOKUP_3_INNER:
-                for (int j = 0; j < repeat_times; j++)
-                {
-#pragma HLS UNROLL
-                    lookup_table_CCL[start_pos + j].symbol = i;
-                    lookup_table_CCL[start_pos + j].valid_bits = len;
-                }
-            }
+            // FCOMMENT
+            decoder_skip_string(input, bit_buffer, buffer_bits_num, done_input);
         }
+        if (FLG & 0x02)
+        {
+            // FHCRC, not checked
+            refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
+            bit_buffer >>= 16;
+            buffer_bits_num -= 16;
+        }
+    }
 
-        // Decode the CL1 sequence
-        unsigned CL1_count = 0;
-        unsigned CL1_num = HLIT + 257;
-        uint7_t copy_7_bits;
+    return errors;
+}
 
-    DECODE_CL1:
-        while (CL1_count < CL1_num)
-        { // still need to decode the CL1 sequence
-#pragma HLS PIPELINE
+void huffman_decoder(hls::stream<axi_word_32> &input, hls::stream<uint32_t> &output, unsigned format)
+{
 
-        DECODE_CL1_INPUT:
-            while (buffer_bits_num < 16)
-            {
-                // shift input into the processing buffer, if the buffer is too short
-                // use a loop, not if statement. otherwise, the input process would be wrong!
+    uint64_t bit_buffer;    // 64-bit shift register holding the input bits, LSB-first
+    int buffer_bits_num;    // the number of valid bits in bit_buffer
 
-                proc_buffer |= (next_word >> buffer_bits_num);
+    unsigned proc_bits_num; // the number of bits were processed in this iteration
 
-                if ((32 - buffer_bits_num) <= next_word_bits)
-                {
-                    // fill the entire buffer
-                    next_word <<= (32 - buffer_bits_num);
-                    next_word_bits -= (32 - buffer_bits_num);
-                    buffer_bits_num = 32;
-                }
-                else
-                {
-                    // not fill the entire buffer, read the input stream
-                    buffer_bits_num += next_word_bits;
-                    next_word_bits = 0;
-                }
+    bool last_block = false; // BFINAL of the current block
+    bool done_block;
+    bool done_input = false;
 
-                if (next_word_bits == 0)
-                {
-                    if (!input.empty())
-                    {
-                        input.read(next_word);
-                        changeToLittleEndian(next_word);
-                        next_word_bits = 32;
-                    }
-                    else
-                    {
-                        // the input stream is empty
-                        // normally, impossible to reach here
-                        cout << "Wrong! Input stream should not be empty here."
-                             << endl;
-                    }
-                }
-            }
+    uint3_t block_header;
+    uint2_t block_type;
 
-            copy_7_bits = (proc_buffer & 0xFE000000) >> 25;
-            uint9_t symbol = lookup_table_CCL[copy_7_bits].symbol;
-            unsigned symbol_valid_bits = lookup_table_CCL[copy_7_bits].valid_bits;
-            if (symbol == 16)
-            {
-                // CCL = 16
-                uint2_t extra_2_bits = (proc_buffer >> (30 - symbol_valid_bits)) & 0x03;
+    unsigned length; // the length after decoding
+    unsigned offset; // the offset corresponding to the previous length;
 
-                // Little-Endian Modification Here - swap the 2 bits
-                extra_2_bits = reverse(extra_2_bits, 2);
+    uint5_t HLIT, HDIST;
+    uint4_t HCLEN;
+    uint3_t CCL[19];
+#pragma HLS ARRAY_PARTITION variable = CCL complete dim = 1
 
-                uint8_t repeat_count = extra_2_bits + 3;
-                unsigned repeated_length = hTable1[CL1_count - 1].valid_length;
+    code_table_node hTable1[286];
+    // Huffman Table 1 for literals and lengths
+#pragma HLS ARRAY_PARTITION variable = hTable1 cyclic factor = 8 dim = 1
+    code_table_node hTable2[30];
+    // Huffman Table 2 for distances
+#pragma HLS ARRAY_PARTITION variable = hTable2 cyclic factor = 8 dim = 1
+    CCL_code hTable3[19];
+    // Huffman Table 3
+    unsigned bl_count_1[16], bl_count_2[16];
+    // the count of each code length in Huffman Table 1 and 2, updated while decoding CL
+#pragma HLS ARRAY_PARTITION variable = bl_count_1 complete dim = 1
+#pragma HLS ARRAY_PARTITION variable = bl_count_2 complete dim = 1
+
+    Lookup_Node lookup_table_CCL[128];
+    // 7 bits table for CL1/2 decoding -> should be 0~127
+    Lookup_Node lookup_table_LIT_1[512];
+    // 9 bits table for first level lookup of LIT
+    Lookup_Node lookup_table_DIST_1[64];
+    // 6 bits table for first level lookup of DIST
+
+    unsigned errors; // INFLATE_* errors, passed on with TOKEN_END
+    uint32_t decoder_cycles = 0; // iterations of the decoding loops
+
+    bit_buffer = 0;
+    buffer_bits_num = 0;
+
+    errors = decoder_skip_header(input, bit_buffer, buffer_bits_num, done_input, format);
+
+BLOCK_LOOP:
+    while (!last_block)
+    {
+        // fill the header bits of the next block into the bit buffer
+        refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
 
-            FILL_HTABLE1_SYMBOL16:
-                for (int i = 0; i < repeat_count; i++)
-                {
-#pragma HLS UNROLL
-                    hTable1[CL1_count + i].valid_length = repeated_length;
-                }
-                CL1_count += repeat_count;
+        if (buffer_bits_num < 3)
+        {
+            // the input stream is empty
+            // normally, impossible to reach here
+            cout << "Wrong! Input stream ends before the last block." << endl;
+            errors |= INFLATE_DATA_ERROR;
+            break;
+        }
 
-                proc_buffer <<= (symbol_valid_bits + 2);
-                buffer_bits_num -= (symbol_valid_bits + 2);
-            }
-            else if (symbol == 17)
-            {
-                // CCL = 17
-                uint3_t extra_3_bits = (proc_buffer >> (29 - symbol_valid_bits)) & 0x07;
+        // BFINAL, then BTYPE
+        block_header = bit_buffer & 0x7;
+        last_block = block_header & 0x1;
+        block_type = block_header >> 1;
 
-                // Little-Endian Modification Here - swap the 3 bits
-                extra_3_bits = reverse(extra_3_bits, 3);
+        bit_buffer >>= 3;
+        buffer_bits_num -= 3;
 
-                uint8_t repeat_count = extra_3_bits + 3;
+        if (block_type == 0)
+        {
+            // no compression, skip to the next byte boundary
+            // the buffer is always refilled by whole bytes
+            bit_buffer >>= (buffer_bits_num % 8);
+            buffer_bits_num -= (buffer_bits_num % 8);
 
-            FILL_HTABLE1_SYMBOL17:
-                for (int i = 0; i < repeat_count; i++)
-                {
-#pragma HLS UNROLL
-                    hTable1[CL1_count + i].valid_length = 0;
-                }
-                CL1_count += repeat_count;
+            refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
 
-                proc_buffer <<= (symbol_valid_bits + 3);
-                buffer_bits_num -= (symbol_valid_bits + 3);
-            }
-            else if (symbol == 18)
-            {
-                // CCL = 18
-                uint7_t extra_7_bits = (proc_buffer >> (25 - symbol_valid_bits)) & 0x07F;
+            // LEN, followed by its complement NLEN
+            unsigned stored_length = bit_buffer & 0xFFFF;
+            unsigned stored_length_complement = (bit_buffer >> 16) & 0xFFFF;
 
-                // Little-Endian Modification Here - swap the 7 bits
-                extra_7_bits = reverse(extra_7_bits, 7);
+            if (buffer_bits_num < 32 || stored_length_complement != (~stored_length & 0xFFFF))
+            {
+                // truncated, or NLEN does not match LEN
+                errors |= INFLATE_DATA_ERROR;
+                break;
+            }
 
-                uint8_t repeat_count = extra_7_bits + 11;
+            bit_buffer >>= 32;
+            buffer_bits_num -= 32;
 
-            FILL_HTABLE1_SYMBOL18:
-                for (int i = 0; i < repeat_count; i++)
+        STORED_COPY:
+            for (unsigned i = 0; i < stored_length; i++)
+            {
+#pragma HLS PIPELINE II = 1
+#pragma HLS loop_tripcount min = 0 max = 65535
+                // just copy the literals directly (following the standard)
+                refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
+                decoder_cycles++;
+                MODEL_ITERATION(MODEL_STORED_COPY);
+
+                if (buffer_bits_num < 8)
                 {
-#pragma HLS UNROLL
-                    hTable1[CL1_count + i].valid_length = 0;
+                    // the input ends inside the block
+                    errors |= INFLATE_DATA_ERROR;
+                    break;
                 }
-                CL1_count += repeat_count;
 
-                proc_buffer <<= (symbol_valid_bits + 7);
-                buffer_bits_num -= (symbol_valid_bits + 7);
+                output.write(TOKEN_LITERAL | (bit_buffer & 0xFF));
+                bit_buffer >>= 8;
+                buffer_bits_num -= 8;
             }
-            else
-            {
-                // CCL from 0 to 15
-                hTable1[CL1_count].valid_length = symbol;
-                CL1_count++;
 
-                proc_buffer <<= symbol_valid_bits;
-                buffer_bits_num -= symbol_valid_bits;
-            }
+            if (errors & INFLATE_DATA_ERROR)
+                break;
         }
-
-    FILL_HTABLE1_REMAINING:
-        while (CL1_count < 286)
+        else if (block_type == 1 || block_type == 2)
         {
-#pragma HLS UNROLL
-            hTable1[CL1_count++].valid_length = 0;
-        }
+            // static (01) or dynamic (10) Huffman encoding
+            // Both use the same lookup path; a static block reads the fixed ROMs.
+            bool is_static = (block_type == 1);
 
-        // Generate Huffman Table 1
-        get_huffman_table_1(hTable1);
+            if (!is_static)
+            {
+                refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
 
-        // Decode the CL2 sequence
-        unsigned CL2_count = 0;
-        unsigned CL2_num = HDIST + 1;
+                HLIT = bit_buffer & 0x1F;
+                HDIST = (bit_buffer >> 5) & 0x1F;
+                HCLEN = (bit_buffer >> 10) & 0xF;
 
-    DECODE_CL2:
-        while (CL2_count < CL2_num)
-        {
+                // Get CCL codes
+                bit_buffer >>= 14;
+                buffer_bits_num -= 14;
+
+                if (HLIT > 29 || HDIST > 29)
+                {
+                    // more than 286 literal/length or 30 distance codes
+                    errors |= INFLATE_DATA_ERROR;
+                    break;
+                }
+
+                int CCL_index = 0;
+            GET_CCL:
+                for (; CCL_index < (HCLEN + 4); CCL_index++)
+                {
 #pragma HLS PIPELINE
-            // still need to decode the CL2 sequence
+                    MODEL_ITERATION(MODEL_GET_CCL);
 
-        DECODE_CL2_INPUT:
-            while (buffer_bits_num < 16)
-            {
-                // shift input into the processing buffer, if the buffer is too short
-                // use a loop, not if statement. otherwise, the input process would be wrong!
+                    refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
 
-                proc_buffer |= (next_word >> buffer_bits_num);
+                    CCL[CCL_index] = bit_buffer & 0x7;
 
-                if ((32 - buffer_bits_num) <= next_word_bits)
+                    bit_buffer >>= 3;
+                    buffer_bits_num -= 3;
+                }
+            FILL_REMAINING_CCL:
+                for (; CCL_index < 19; CCL_index++)
                 {
-                    // fill the entire buffer
-                    next_word <<= (32 - buffer_bits_num);
-                    next_word_bits -= (32 - buffer_bits_num);
-                    buffer_bits_num = 32;
+#pragma HLS UNROLL
+                    // fill in remaining CCL array
+                    CCL[CCL_index] = 0;
                 }
-                else
+                permute_CCL(CCL, hTable3);                     // permute the CCL code
+                int CCL_space = get_huffman_table_3(hTable3); // generate the Huffman table 3
+
+                if (CCL_space < 0)
                 {
-                    // not fill the entire buffer, read the input stream
-                    buffer_bits_num += next_word_bits;
-                    next_word_bits = 0;
+                    // over-subscribed, the codes overlap
+                    errors |= INFLATE_DATA_ERROR;
+                    break;
                 }
 
-                if (next_word_bits == 0)
+                if (CCL_space > 0)
                 {
-                    if (!input.empty())
+                    // incomplete, clear the entries of the previous block
+                CLEAR_LOOKUP_TABLE_3:
+                    for (int i = 0; i < 128; i++)
                     {
-                        input.read(next_word);
-                        changeToLittleEndian(next_word);
-                        next_word_bits = 32;
+#pragma HLS UNROLL factor = 8
+                        lookup_table_CCL[i].symbol = LOOKUP_NO_CODE;
+                        lookup_table_CCL[i].valid_bits = 0;
                     }
-                    else
+                }
+
+                // Build the lookup table for Huffman table 3
+            BUILD_LOOKUP_TABLE_3:
+                for (int i = 0; i < 19; i++)
+                {
+#pragma HLS UNROLL
+                    // for each CCL
+                    if (hTable3[i].length != 0)
                     {
-                        // the input stream is empty
-                        // normally, impossible to reach here
-                        cout << "Wrong! Input stream should not be empty here."
-                             << endl;
+                        // index by the code as it appears in the stream, LSB-first
+                        unsigned len = hTable3[i].length;
+                        unsigned start_pos = reverse(uint8_t(hTable3[i].code), 7) >> (7 - len);
+                        unsigned repeat_times = (1 << (7 - len));
+
+                    BUILD_LOOKUP_3_INNER:
+                        for (unsigned j = 0; j < repeat_times; j++)
+                        {
+#pragma HLS UNROLL
+                            lookup_table_CCL[start_pos | (j << len)].symbol = i;
+                            lookup_table_CCL[start_pos | (j << len)].valid_bits = len;
+                        }
                     }
                 }
-            }
-
-            copy_7_bits = (proc_buffer & 0xFE000000) >> 25;
-            uint9_t symbol = lookup_table_CCL[copy_7_bits].symbol;
-            unsigned symbol_valid_bits = lookup_table_CCL[copy_7_bits].valid_bits;
-            if (symbol == 16)
-            {
-                // CCL = 16
-                uint2_t extra_2_bits = (proc_buffer >> (30 - symbol_valid_bits)) & 0x03;
-
-                // Add Little-Endian Modification Here - swap the 2 bits
-                extra_2_bits = reverse(extra_2_bits, 2);
 
-                uint8_t repeat_count = extra_2_bits + 3;
-                unsigned repeated_length = hTable2[CL2_count - 1].valid_length;
-
-            FILL_HTABLE2_SYMBOL16:
-                for (int i = 0; i < repeat_count; i++)
+                // Clear the code lengths in parallel. Runs of zero lengths
+                // (CCL = 17, 18) then only advance the count.
+            CLEAR_HTABLE1:
+                for (int i = 0; i < 286; i++)
+                {
+#pragma HLS UNROLL factor = 8
+                    hTable1[i].valid_length = 0;
+                }
+            CLEAR_HTABLE2:
+                for (int i = 0; i < 30; i++)
+                {
+#pragma HLS UNROLL factor = 8
+                    hTable2[i].valid_length = 0;
+                }
+            CLEAR_BL_COUNT:
+                for (int i = 0; i < 16; i++)
                 {
 #pragma HLS UNROLL
-                    hTable2[CL2_count + i].valid_length = repeated_length;
+                    bl_count_1[i] = 0;
+                    bl_count_2[i] = 0;
                 }
-                CL2_count += repeat_count;
 
-                proc_buffer <<= (symbol_valid_bits + 2);
-                buffer_bits_num -= (symbol_valid_bits + 2);
-            }
-            else if (symbol == 17)
-            {
-                // CCL = 17
-                uint3_t extra_3_bits = (proc_buffer >> (29 - symbol_valid_bits)) & 0x07;
-
-                // Little-Endian Modification Here - swap the 3 bits
-                extra_3_bits = reverse(extra_3_bits, 3);
+                // Decode the CL1 and CL2 sequence. Both form one sequence, so
+                // a repeat code may run across the boundary of the two tables.
+                unsigned CL_count = 0;
+                unsigned CL1_num = HLIT + 257;
+                unsigned CL_num = CL1_num + HDIST + 1;
+                unsigned prev_length = 0; // the last code length, repeated by CCL = 16
+                uint7_t copy_7_bits;
+
+            DECODE_CL:
+                while (CL_count < CL_num)
+                { // still need to decode the CL sequence
+#pragma HLS PIPELINE
+                    MODEL_ITERATION(MODEL_DECODE_CL);
 
-                uint8_t repeat_count = extra_3_bits + 3;
+                    refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
 
-            FILL_HTABLE2_SYMBOL17:
-                for (int i = 0; i < repeat_count; i++)
-                {
-#pragma HLS UNROLL
-                    hTable2[CL2_count + i].valid_length = 0;
-                }
-                CL2_count += repeat_count;
+                    copy_7_bits = bit_buffer & 0x7F;
+                    uint9_t symbol = lookup_table_CCL[copy_7_bits].symbol;
+                    unsigned symbol_valid_bits = lookup_table_CCL[copy_7_bits].valid_bits;
+                    unsigned repeat_count, repeat_count_1;
 
-                proc_buffer <<= (symbol_valid_bits + 3);
-                buffer_bits_num -= (symbol_valid_bits + 3);
-            }
-            else if (symbol == 18)
-            {
-                // CCL = 18
-                uint7_t extra_7_bits = (proc_buffer >> (25 - symbol_valid_bits)) & 0x07F;
+                    if (symbol > 18 || (symbol == 16 && CL_count == 0))
+                    {
+                        // no code, or no length to repeat yet
+                        errors |= INFLATE_DATA_ERROR;
+                        break;
+                    }
+                    else if (symbol == 16)
+                    {
+                        // CCL = 16, repeat the previous length 3-6 times
+                        uint2_t extra_2_bits = (bit_buffer >> symbol_valid_bits) & 0x03;
+                        repeat_count = extra_2_bits + 3;
 
-                // Little-Endian Modification Here - swap the 7 bits
-                extra_7_bits = reverse(extra_7_bits, 7);
+                        proc_bits_num = symbol_valid_bits + 2;
+                    }
+                    else if (symbol == 17)
+                    {
+                        // CCL = 17, 3-10 zero lengths
+                        uint3_t extra_3_bits = (bit_buffer >> symbol_valid_bits) & 0x07;
+                        prev_length = 0;
+                        repeat_count = extra_3_bits + 3;
 
-                uint8_t repeat_count = extra_7_bits + 11;
+                        proc_bits_num = symbol_valid_bits + 3;
+                    }
+                    else if (symbol == 18)
+                    {
+                        // CCL = 18, 11-138 zero lengths
+                        uint7_t extra_7_bits = (bit_buffer >> symbol_valid_bits) & 0x07F;
+                        prev_length = 0;
+                        repeat_count = extra_7_bits + 11;
 
-            FILL_HTABLE2_SYMBOL18:
-                for (int i = 0; i < repeat_count; i++)
-                {
-#pragma HLS UNROLL
-                    hTable2[CL2_count + i].valid_length = 0;
-                }
-                CL2_count += repeat_count;
+                        proc_bits_num = symbol_valid_bits + 7;
+                    }
+                    else
+                    {
+                        // CCL from 0 to 15
+                        prev_length = symbol;
+                        repeat_count = 1;
 
-                proc_buffer <<= (symbol_valid_bits + 7);
-                buffer_bits_num -= (symbol_valid_bits + 7);
-            }
-            else
-            {
-                // CCL from 0 to 15
-                hTable2[CL2_count].valid_length = symbol;
-                CL2_count++;
+                        proc_bits_num = symbol_valid_bits;
+                    }
 
-                proc_buffer <<= symbol_valid_bits;
-                buffer_bits_num -= symbol_valid_bits;
-            }
-        }
+                    if (CL_count + repeat_count > CL_num)
+                    {
+                        // the repeat runs past the HLIT + HDIST lengths
+                        errors |= INFLATE_DATA_ERROR;
+                        break;
+                    }
 
-    FILL_HTABLE2_REMAINING:
-        while (CL2_count < 30)
-        {
+                    if (prev_length != 0)
+                    {
+                        // write up to 6 lengths in one step, zero lengths are already cleared
+                    FILL_CL:
+                        for (unsigned i = 0; i < 6; i++)
+                        {
 #pragma HLS UNROLL
-            hTable2[CL2_count++].valid_length = 0;
-        }
+                            if (i < repeat_count)
+                            {
+                                if (CL_count + i < CL1_num)
+                                    hTable1[CL_count + i].valid_length = prev_length;
+                                else
+                                    hTable2[CL_count + i - CL1_num].valid_length = prev_length;
+                            }
+                        }
+
+                        // update the count of the length in each table
+                        if (CL_count + repeat_count <= CL1_num)
+                            repeat_count_1 = repeat_count;
+                        else if (CL_count < CL1_num)
+                            repeat_count_1 = CL1_num - CL_count;
+                        else
+                            repeat_count_1 = 0;
+
+                        bl_count_1[prev_length] += repeat_count_1;
+                        bl_count_2[prev_length] += repeat_count - repeat_count_1;
+                    }
 
-        // Generate Huffman Table 2
-        get_huffman_table_2(hTable2);
+                    CL_count += repeat_count;
 
-        // Build the lookup table for Huffman Table 1 & 2
-    BUILD_LOOKUP_TABLE_1:
-        for (int i = 0; i < 286; i++)
-        {
-#pragma HLS UNROLL
-            // for each edoc in lit/length table
-            if (hTable1[i].valid_length != 0)
-            {
-                unsigned len = hTable1[i].valid_length;
+                    bit_buffer >>= proc_bits_num;
+                    buffer_bits_num -= proc_bits_num;
+                }
 
-                if (len <= 9)
+                if (errors & INFLATE_DATA_ERROR)
+                    break;
+
+                // Generate Huffman Table 1 & 2 from the counts gathered above
+                MODEL_ITERATION(MODEL_BUILD_TABLES);
+                bool long_codes = false; // a code too long for the first level lookup
+                int LIT_space = get_huffman_table_1(hTable1, bl_count_1);
+                int DIST_space = get_huffman_table_2(hTable2, bl_count_2);
+
+                if (LIT_space < 0 || DIST_space < 0)
                 {
-                    // can be searched in the first level lookup
-                    unsigned start_pos = hTable1[i].code << (9 - len);
-                    unsigned repeat_times = (1 << (9 - len));
+                    // over-subscribed, the codes overlap
+                    errors |= INFLATE_DATA_ERROR;
+                    break;
+                }
 
-                BUILD_LOOKUP_1_INNER:
-                    for (int j = 0; j < repeat_times; j++)
+                // incomplete codes, clear the entries of the previous block
+                if (LIT_space > 0)
+                {
+                CLEAR_LOOKUP_TABLE_1:
+                    for (int i = 0; i < 512; i++)
                     {
-#pragma HLS UNROLL
-                        lookup_table_LIT_1[start_pos + j].symbol = i; // assign the edoc to the symbol
-                        lookup_table_LIT_1[start_pos + j].valid_bits = len;
+#pragma HLS UNROLL factor = 8
+                        lookup_table_LIT_1[i].symbol = LOOKUP_NO_CODE;
+                        lookup_table_LIT_1[i].valid_bits = 0;
                     }
                 }
-                else
+                if (DIST_space > 0)
                 {
-                    // need to use second level searching
-                    // ...
+                CLEAR_LOOKUP_TABLE_2:
+                    for (int i = 0; i < 64; i++)
+                    {
+#pragma HLS UNROLL factor = 8
+                        lookup_table_DIST_1[i].symbol = LOOKUP_NO_CODE;
+                        lookup_table_DIST_1[i].valid_bits = 0;
+                    }
                 }
-            }
-        }
 
-    BUILD_LOOKUP_TABLE_2:
-        for (int i = 0; i < 30; i++)
-        {
+                // Build the lookup table for Huffman Table 1 & 2
+            BUILD_LOOKUP_TABLE_1:
+                for (int i = 0; i < 286; i++)
+                {
 #pragma HLS UNROLL
-            // for each edoc in distance table
-            if (hTable2[i].valid_length != 0)
-            {
-                unsigned len = hTable2[i].valid_length;
+                    // for each edoc in lit/length table
+                    if (hTable1[i].valid_length != 0)
+                    {
+                        unsigned len = hTable1[i].valid_length;
+
+                        if (len <= 9)
+                        {
+                            // can be searched in the first level lookup
+                            // index by the code as it appears in the stream, LSB-first
+                            unsigned start_pos = reverse(uint16_t(hTable1[i].code), 9) >> (9 - len);
+                            unsigned repeat_times = (1 << (9 - len));
+
+                        BUILD_LOOKUP_1_INNER:
+                            for (unsigned j = 0; j < repeat_times; j++)
+                            {
+#pragma HLS UNROLL
+                                lookup_table_LIT_1[start_pos | (j << len)].symbol = i; // assign the edoc to the symbol
+                                lookup_table_LIT_1[start_pos | (j << len)].valid_bits = len;
+                            }
+                        }
+                        else
+                        {
+                            // needs a second level lookup, not supported
+                            long_codes = true;
+                        }
+                    }
+                }
 
-                if (len <= 6)
+            BUILD_LOOKUP_TABLE_2:
+                for (int i = 0; i < 30; i++)
                 {
-                    // can be searched in the first level lookup
-                    unsigned start_pos = hTable2[i].code << (6 - len);
-                    unsigned repeat_times = (1 << (6 - len));
-
-                BUILD_LOOKUP_2_INNER:
-                    for (int j = 0; j < repeat_times; j++)
+#pragma HLS UNROLL
+                    // for each edoc in distance table
+                    if (hTable2[i].valid_length != 0)
                     {
+                        unsigned len = hTable2[i].valid_length;
+
+                        if (len <= 6)
+                        {
+                            // can be searched in the first level lookup
+                            // index by the code as it appears in the stream, LSB-first
+                            unsigned start_pos = reverse(uint16_t(hTable2[i].code), 6) >> (6 - len);
+                            unsigned repeat_times = (1 << (6 - len));
+
+                        BUILD_LOOKUP_2_INNER:
+                            for (unsigned j = 0; j < repeat_times; j++)
+                            {
 #pragma HLS UNROLL
-                        lookup_table_DIST_1[start_pos + j].symbol = i; // assign the edoc to the symbol
-                        lookup_table_DIST_1[start_pos + j].valid_bits = len;
+                                lookup_table_DIST_1[start_pos | (j << len)].symbol = i; // assign the edoc to the symbol
+                                lookup_table_DIST_1[start_pos | (j << len)].valid_bits = len;
+                            }
+                        }
+                        else
+                        {
+                            // needs a second level lookup, not supported
+                            long_codes = true;
+                        }
                     }
                 }
-                else
+
+                if (long_codes)
                 {
-                    // need to use second level searching
-                    // ...
+                    // stop instead of decoding with a wrong table
+                    errors |= INFLATE_DATA_ERROR;
+                    break;
                 }
             }
-        }
 
-        // Finally, decode the remaining LIT and DIST stream (Real compressed data)
-    DYNAMIC_MAIN_LOOP:
-        while (buffer_bits_num > 0 && !done_decoding)
-        {
-#pragma HLS PIPELINE
-            // the processing buffer is not empty - still need to decode
-
-        DYNAMIC_INPUT:
-            while (buffer_bits_num < 24 && !done_input)
+            // Finally, decode the remaining LIT and DIST stream (Real compressed data)
+            done_block = false;
+        DECODE_MAIN_LOOP:
+            while (buffer_bits_num > 0 && !done_block)
             {
-#pragma HLS PIPELINE
-                // shift input into the processing buffer, if the buffer is too short
+#pragma HLS PIPELINE II = 1
+                // the processing buffer is not empty - still need to decode
+
+                // single-step refill, more than 32 valid bits after this point
+                refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
+                decoder_cycles++;
+                MODEL_ITERATION(MODEL_DECODE_MAIN_LOOP);
 
-                proc_buffer |= (next_word >> buffer_bits_num);
+                uint9_t copy_9_bits = bit_buffer & 0x1FF;
+                Lookup_Node lit_node = is_static ? FIXED_LOOKUP_LIT[copy_9_bits] : lookup_table_LIT_1[copy_9_bits]; // not consider second level lookup
+                uint9_t edoc = lit_node.symbol;
+                proc_bits_num = lit_node.valid_bits;
 
-                if ((32 - buffer_bits_num) <= next_word_bits)
+                if (edoc <= 255)
                 {
-                    // fill the entire buffer
-                    next_word <<= (32 - buffer_bits_num);
-                    next_word_bits -= (32 - buffer_bits_num);
-                    buffer_bits_num = 32;
+                    // a literal, copy it to the output
+                    output.write(TOKEN_LITERAL | edoc);
                 }
-                else
+                else if (edoc == 256)
                 {
-                    // not fill the entire buffer, read the input stream
-                    buffer_bits_num += next_word_bits;
-                    next_word_bits = 0;
+                    // reach the last edoc of this block
+                    done_block = true;
                 }
-
-                if (next_word_bits == 0)
+                else if (edoc > 285)
+                {
+                    // 286, 287 and LOOKUP_NO_CODE have no length: stop
+                    errors |= INFLATE_DATA_ERROR;
+                    done_block = true;
+                }
+                else
                 {
-                    if (!input.empty())
+                    // meet a length, edoc: 257-285
+                    unsigned length_extra_bits_num = LENGTH_EXTRA[edoc - 257];
+                    length = LENGTH_BASE[edoc - 257] + decoder_get_extra_bits(bit_buffer, proc_bits_num, length_extra_bits_num);
+                    proc_bits_num += length_extra_bits_num;
+
+                    // get the corresponding offset
+                    offset = decoder_get_offset(proc_bits_num, bit_buffer, is_static, lookup_table_DIST_1);
+
+                    if (offset == 0)
                     {
-                        input.read(next_word);
-                        changeToLittleEndian(next_word);
-                        next_word_bits = 32;
+                        // a distance code without a distance: stop
+                        errors |= INFLATE_DATA_ERROR;
+                        done_block = true;
                     }
                     else
                     {
-                        // the input stream is empty
-                        done_input = true;
+                        // write the results to decoding output
+                        output.write(TOKEN_MATCH | (length << 16) | offset);
                     }
                 }
-            }
 
-            uint9_t copy_9_bits = (proc_buffer & 0xFF800000) >> 23;
-            uint9_t edoc = lookup_table_LIT_1[copy_9_bits].symbol; // not consider second level lookup
-            unsigned edoc_valid_bits = lookup_table_LIT_1[copy_9_bits].valid_bits;
-
-            if (edoc >= 0 && edoc <= 255)
-            {
-                // a literal, copy it to the output
-                decoding_output[output_pos++] = edoc;
-                proc_bits_num = edoc_valid_bits;
+                // modify the bit buffer
+                bit_buffer >>= proc_bits_num;
+                buffer_bits_num -= proc_bits_num;
+                proc_bits_num = 0;
             }
-            else if (edoc == 256)
+
+            if (!done_block || buffer_bits_num < 0)
             {
-                // reach the last edoc, stop decoding
-                proc_bits_num = edoc_valid_bits;
-                done_decoding = true;
+                // the input ends inside the block
+                errors |= INFLATE_DATA_ERROR;
             }
-            else
-            {
-                // meet a length
 
-                // Note: need to add modifications for every extra bits below
-                if (edoc >= 257 && edoc <= 264)
-                {
-                    // 257-264
-                    length = edoc - 254;
-                    proc_bits_num = edoc_valid_bits;
-                }
-                else if (edoc >= 265 && edoc <= 268)
-                {
-                    // 265-268
-                    length = (11 + 2 * (edoc - 265)) + ((proc_buffer >> (31 - edoc_valid_bits)) & 0x01);
-                    proc_bits_num = edoc_valid_bits + 1;
-                }
-                else if (edoc >= 269 && edoc <= 272)
-                {
-                    // 269-272
-                    length = (19 + 4 * (edoc - 269)) + reverse(((proc_buffer >> (30 - edoc_valid_bits)) & 0x03), 2);
-                    proc_bits_num = edoc_valid_bits + 2;
-                }
-                else if (edoc >= 273 && edoc <= 276)
-                {
-                    // 273-276
-                    length = (35 + 8 * (edoc - 273)) + reverse(((proc_buffer >> (29 - edoc_valid_bits)) & 0x07), 3);
-                    proc_bits_num = edoc_valid_bits + 3;
-                }
-                else if (edoc >= 277 && edoc <= 280)
-                {
-                    // 277-280
-                    length = (67 + 16 * (edoc - 277)) + reverse(((proc_buffer >> (28 - edoc_valid_bits)) & 0x0F), 4);
-                    proc_bits_num = edoc_valid_bits + 4;
-                }
-                else if (edoc >= 281 && edoc <= 284)
-                {
-                    // 281-284
-                    length = (131 + 32 * (edoc - 281)) + reverse(((proc_buffer >> (27 - edoc_valid_bits)) & 0x1F), 5);
-                    proc_bits_num = edoc_valid_bits + 5;
-                }
-                else
-                {
-                    // 285
-                    length = 258;
-                    proc_bits_num = edoc_valid_bits;
-                }
+            if (errors & INFLATE_DATA_ERROR)
+                break;
+        }
+        else
+        {
+            // illegal header code - wrong
+            cout << "illegal code" << endl;
+            errors |= INFLATE_DATA_ERROR;
+            break;
+        }
+    }
 
-                // get the corresponding offset
-                offset = dynamic_decoder_get_offset(proc_bits_num, proc_buffer, lookup_table_DIST_1);
+    // zlib: Adler-32, MSB first; gzip: CRC-32, then ISIZE, LSB first
+    uint32_t trailer[2];
+    int trailer_words = format == FORMAT_GZIP ? 2 : format == FORMAT_ZLIB ? 1 : 0;
 
-                // write the results to decoding output
-                decoding_output[output_pos] = '@';
-                decoding_output[output_pos + 1] = offset >> 7;
-                decoding_output[output_pos + 2] = (offset & 0x07F);
-                decoding_output[output_pos + 3] = length;
-                output_pos += 4;
-            }
+    if (buffer_bits_num < 0)
+        errors |= INFLATE_DATA_ERROR; // more bits were taken than the input had
+    if (errors & INFLATE_DATA_ERROR)
+        trailer_words = 0; // no trailer after a data error, nor a checksum check
+
+    if (trailer_words != 0)
+    {
+        // the trailer starts at the next byte boundary
+        bit_buffer >>= (buffer_bits_num % 8);
+        buffer_bits_num -= (buffer_bits_num % 8);
+    }
+
+READ_TRAILER:
+    for (int i = 0; i < trailer_words; i++)
+    {
+        refill_bit_buffer(input, bit_buffer, buffer_bits_num, done_input);
 
-            // modify the proc_buffer
-            proc_buffer <<= proc_bits_num;
-            buffer_bits_num -= proc_bits_num;
-            proc_bits_num = 0;
+        if (buffer_bits_num < 32)
+        {
+            // the input ends inside the trailer
+            errors |= INFLATE_DATA_ERROR;
+            trailer_words = 0;
+            break;
         }
+
+        trailer[i] = format == FORMAT_ZLIB ? byte_swap((uint32_t)bit_buffer) : (uint32_t)bit_buffer;
+        bit_buffer >>= 32;
+        buffer_bits_num -= 32;
     }
-    else
+
+    // finish the token stream, then the trailer
+    output.write(TOKEN_END | errors);
+WRITE_TRAILER:
+    for (int i = 0; i < trailer_words; i++)
     {
-        // illegal header code - wrong
-        cout << "illegal code" << endl;
+        output.write(trailer[i]);
     }
 
-    // finish the output array
-    decoding_output[output_pos] = '\0';
-
-    //    // print out the decoding output - for testing
-    //    int i = 0;
-    //    unsigned offset_print, length_print;
-    //    cout << endl << "The stream after Huffman decoding: " << endl << endl;
-    //    while (decoding_output[i] != '\0') {
-    //        if (decoding_output[i] == '@') {
-    //            offset_print = (decoding_output[i + 1] * 128)
-    //                    + decoding_output[i + 2];
-    //            length_print = decoding_output[i + 3];
-    //            cout << "@(" << offset_print << "," << length_print << ")";
-    //            i += 4;
-    //        } else {
-    //            cout << decoding_output[i++];
-    //        }
-    //    }
-    //
-    //    cout << endl;
+    // drop the rest of the job, up to TLAST
+    axi_word_32 drain_word;
+DRAIN_INPUT:
+    while (!done_input)
+    {
+#pragma HLS PIPELINE II = 1
+        input.read(drain_word);
+        done_input = drain_word.last;
+    }
+
+    // pass on the counters: decoding cycles, then the input bytes and stalls of stream_unpack
+    output.write(decoder_cycles);
+COPY_COUNTERS:
+    for (int i = 0; i < 2; i++)
+    {
+        input.read(drain_word);
+        output.write(drain_word.data);
+    }
 
     return;
 }
@@ -816,7 +851,7 @@ T reverse(T n, unsigned bits_num)
 {
     T rv = 0;
 REVERSE_BITS:
-    for (int i = 0; i < bits_num; i++)
+    for (unsigned i = 0; i < bits_num; i++)
     {
 #pragma HLS PIPELINE
         rv <<= 1;
@@ -826,108 +861,57 @@ REVERSE_BITS:
     return rv;
 }
 
-// Function to modify the input word to little-endian
-void changeToLittleEndian(uint32_t &next_word)
+// Refill the 64-bit bit buffer in a single step: whenever no more than 32 bits
+// are valid, one input word is shifted in right above the valid bits. Afterwards,
+// more than 32 bits are valid unless the word with TLAST was read. That word
+// only adds the bits of the bytes its TKEEP marks, so buffer_bits_num < 0 means
+// more bits were taken than the input had.
+void refill_bit_buffer(hls::stream<axi_word_32> &input, uint64_t &bit_buffer,
+                       int &buffer_bits_num, bool &done_input)
 {
-    uint8_t byte1, byte2, byte3, byte4;
-
-    byte1 = reverse(((next_word & 0xFF000000) >> 24), 8);
-    byte2 = reverse(((next_word & 0x00FF0000) >> 16), 8);
-    byte3 = reverse(((next_word & 0x0000FF00) >> 8), 8);
-    byte4 = reverse((next_word & 0x000000FF), 8);
+#pragma HLS INLINE
+    axi_word_32 next_word;
 
-    next_word = (byte1 << 24) | (byte2 << 16) | (byte3 << 8) | byte4;
+    if (buffer_bits_num <= 32 && !done_input)
+    {
+        input.read(next_word);
+        bit_buffer |= (uint64_t)byte_swap(next_word.data) << buffer_bits_num;
+        buffer_bits_num += 8 * ((next_word.keep & 0x1) + ((next_word.keep >> 1) & 0x1) +
+                                ((next_word.keep >> 2) & 0x1) + ((next_word.keep >> 3) & 0x1));
+        done_input = next_word.last;
+    }
 
     return;
 }
 
-unsigned dynamic_decoder_get_offset(unsigned &proc_bits_num, uint32_t proc_buffer,
-                                    Lookup_Node lookup_table_DIST_1[128])
+// Function to get the extra bits starting at bit position pos of the bit buffer
+unsigned decoder_get_extra_bits(uint64_t bit_buffer, unsigned pos, unsigned extra_bits_num)
 {
+#pragma HLS INLINE
+    return (bit_buffer >> pos) & ((1 << extra_bits_num) - 1);
+}
 
-    unsigned offset;
-    uint6_t copy_6_bits = (proc_buffer >> (26 - proc_bits_num)) & 0x0000003F;
+// Function to decode the distance code and its extra bits following a length;
+// 0 for a code without a distance
+unsigned decoder_get_offset(unsigned &proc_bits_num, uint64_t bit_buffer, bool is_static,
+                            Lookup_Node lookup_table_DIST_1[64])
+{
 
-    uint9_t edoc = lookup_table_DIST_1[copy_6_bits].symbol; // not consider second level lookup
-    unsigned edoc_valid_bits = lookup_table_DIST_1[copy_6_bits].valid_bits;
-    proc_bits_num += edoc_valid_bits;
+    uint6_t copy_6_bits = (bit_buffer >> proc_bits_num) & 0x3F;
 
-    // Add Little-Endian Modification Here - should swap the extra bits
+    Lookup_Node dist_node = is_static ? FIXED_LOOKUP_DIST[copy_6_bits] : lookup_table_DIST_1[copy_6_bits]; // not consider second level lookup
+    uint9_t edoc = dist_node.symbol;
+    proc_bits_num += dist_node.valid_bits;
 
-    if (edoc >= 0 && edoc <= 3)
+    if (edoc > 29)
     {
-        offset = edoc + 1;
-    }
-    else if (edoc == 4 || edoc == 5)
-    {
-        offset = edoc * 2 - 3 + ((proc_buffer >> (31 - proc_bits_num)) & 0x1);
-        proc_bits_num += 1;
-    }
-    else if (edoc == 6 || edoc == 7)
-    {
-        offset = edoc * 4 - 15 + reverse(((proc_buffer >> (30 - proc_bits_num)) & 0x3), 2);
-        proc_bits_num += 2;
-    }
-    else if (edoc == 8 || edoc == 9)
-    {
-        offset = edoc * 8 - 47 + reverse(((proc_buffer >> (29 - proc_bits_num)) & 0x7), 3);
-        proc_bits_num += 3;
-    }
-    else if (edoc == 10 || edoc == 11)
-    {
-        offset = edoc * 16 - 127 + reverse(((proc_buffer >> (28 - proc_bits_num)) & 0x0F), 4);
-        proc_bits_num += 4;
-    }
-    else if (edoc == 12 || edoc == 13)
-    {
-        offset = edoc * 32 - 319 + reverse(((proc_buffer >> (27 - proc_bits_num)) & 0x1F), 5);
-        proc_bits_num += 5;
-    }
-    else if (edoc == 14 || edoc == 15)
-    {
-        offset = edoc * 64 - 767 + reverse(((proc_buffer >> (26 - proc_bits_num)) & 0x3F), 6);
-        proc_bits_num += 6;
-    }
-    else if (edoc == 16 || edoc == 17)
-    {
-        offset = edoc * 128 - 1791 + reverse(((proc_buffer >> (25 - proc_bits_num)) & 0x7F), 7);
-        proc_bits_num += 7;
-    }
-    else if (edoc == 18 || edoc == 19)
-    {
-        offset = edoc * 256 - 4095 + reverse(((proc_buffer >> (24 - proc_bits_num)) & 0x0FF), 8);
-        proc_bits_num += 8;
-    }
-    else if (edoc == 20 || edoc == 21)
-    {
-        offset = edoc * 512 - 9215 + reverse(((proc_buffer >> (23 - proc_bits_num)) & 0x1FF), 9);
-        proc_bits_num += 9;
-    }
-    else if (edoc == 22 || edoc == 23)
-    {
-        offset = edoc * 1024 - 20479 + reverse(((proc_buffer >> (22 - proc_bits_num)) & 0x3FF), 10);
-        proc_bits_num += 10;
-    }
-    else if (edoc == 24 || edoc == 25)
-    {
-        offset = 4097 + 2048 * (edoc - 24) + reverse(((proc_buffer >> (21 - proc_bits_num)) & 0x7FF), 11);
-        proc_bits_num += 11;
-    }
-    else if (edoc == 26 || edoc == 27)
-    {
-        offset = 8193 + 4096 * (edoc - 26) + reverse(((proc_buffer >> (20 - proc_bits_num)) & 0x0FFF), 12);
-        proc_bits_num += 12;
-    }
-    else if (edoc == 28 || edoc == 29)
-    {
-        offset = 16385 + 8192 * (edoc - 28) + reverse(((proc_buffer >> (19 - proc_bits_num)) & 0x1FFF), 13);
-        proc_bits_num += 13;
-    }
-    else
-    {
-        cout << "Wrong! Not the right offset range!" << endl;
+        // 30, 31 and LOOKUP_NO_CODE have no distance, 0 marks it invalid
+        return 0;
     }
 
+    unsigned offset = DIST_BASE[edoc] + decoder_get_extra_bits(bit_buffer, proc_bits_num, DIST_EXTRA[edoc]);
+    proc_bits_num += DIST_EXTRA[edoc];
+
     return offset;
 }
 
@@ -958,21 +942,14 @@ void permute_CCL(uint3_t CCL[19], CCL_code hTable3[19])
     return;
 }
 
-void get_huffman_table_1(code_table_node hTable1[286])
+int get_huffman_table_1(code_table_node hTable1[286], unsigned bl_count[16])
 {
 
-    unsigned bl_count[16] = {0};
-    // the count of each length of code
+    // bl_count: the count of each length of code, gathered while decoding the lengths
     unsigned code = 0;
     unsigned next_code[16];
     unsigned len;
-
-    // Count the number of codes for each code length (level)
-    for (int i = 0; i < 286; i++)
-    {
-#pragma HLS PIPELINE
-        bl_count[hTable1[i].valid_length]++;
-    }
+    int space = 1; // the code space left by the codes up to the current length
 
     // Assign a base value to each code length
     bl_count[0] = 0;
@@ -981,6 +958,7 @@ void get_huffman_table_1(code_table_node hTable1[286])
 #pragma HLS PIPELINE
         code = (code + bl_count[bits - 1]) << 1;
         next_code[bits] = code;
+        space = 2 * space - (int)bl_count[bits];
     }
 
     // Use the base value of each length to assign consecutive numerical values
@@ -995,24 +973,17 @@ void get_huffman_table_1(code_table_node hTable1[286])
         }
     }
 
-    return;
+    return space;
 }
 
-void get_huffman_table_2(code_table_node hTable2[30])
+int get_huffman_table_2(code_table_node hTable2[30], unsigned bl_count[16])
 {
 
-    unsigned bl_count[16] = {0};
-    // the count of each length of code
+    // bl_count: the count of each length of code, gathered while decoding the lengths
     unsigned code = 0;
     unsigned next_code[16];
     unsigned len;
-
-    // Count the number of codes for each code length (level)
-    for (int i = 0; i < 30; i++)
-    {
-#pragma HLS PIPELINE
-        bl_count[hTable2[i].valid_length]++;
-    }
+    int space = 1; // the code space left by the codes up to the current length
 
     // Assign a base value to each code length
     bl_count[0] = 0;
@@ -1021,6 +992,7 @@ void get_huffman_table_2(code_table_node hTable2[30])
 #pragma HLS PIPELINE
         code = (code + bl_count[bits - 1]) << 1;
         next_code[bits] = code;
+        space = 2 * space - (int)bl_count[bits];
     }
 
     // Use the base value of each length to assign consecutive numerical values
@@ -1035,10 +1007,10 @@ void get_huffman_table_2(code_table_node hTable2[30])
         }
     }
 
-    return;
+    return space;
 }
 
-void get_huffman_table_3(CCL_code hTable3[19])
+int get_huffman_table_3(CCL_code hTable3[19])
 {
 
     unsigned bl_count[8] = {0};
@@ -1046,6 +1018,7 @@ void get_huffman_table_3(CCL_code hTable3[19])
     unsigned code = 0;
     unsigned next_code[8];
     unsigned len;
+    int space = 1; // the code space left by the codes up to the current length
 
     // Count the number of codes for each code length
     for (int i = 0; i < 19; i++)
@@ -1061,6 +1034,7 @@ void get_huffman_table_3(CCL_code hTable3[19])
 #pragma HLS PIPELINE
         code = (code + bl_count[bits - 1]) << 1;
         next_code[bits] = code;
+        space = 2 * space - (int)bl_count[bits];
     }
 
     // Use the base value of each length to assign consecutive numerical values
@@ -1075,134 +1049,151 @@ void get_huffman_table_3(CCL_code hTable3[19])
         }
     }
 
-    return;
-}
-
-unsigned decoder_get_offset(unsigned &proc_bits_num, uint32_t proc_buffer)
-{
-
-    unsigned offset;
-    uint8_t offset_5_bits = (proc_buffer >> (27 - proc_bits_num)) & 0x0000001F;
-
-    if (offset_5_bits >= 0 && offset_5_bits <= 3)
-    {
-        offset = offset_5_bits + 1;
-        proc_bits_num += 5;
-    }
-    else if (offset_5_bits == 4 || offset_5_bits == 5)
-    {
-        offset = offset_5_bits * 2 - 3 + ((proc_buffer >> (26 - proc_bits_num)) & 0x1);
-        proc_bits_num += 6;
-    }
-    else if (offset_5_bits == 6 || offset_5_bits == 7)
-    {
-        offset = offset_5_bits * 4 - 15 + ((proc_buffer >> (25 - proc_bits_num)) & 0x3);
-        proc_bits_num += 7;
-    }
-    else if (offset_5_bits == 8 || offset_5_bits == 9)
-    {
-        offset = offset_5_bits * 8 - 47 + ((proc_buffer >> (24 - proc_bits_num)) & 0x7);
-        proc_bits_num += 8;
-    }
-    else if (offset_5_bits == 10 || offset_5_bits == 11)
-    {
-        offset = offset_5_bits * 16 - 127 + ((proc_buffer >> (23 - proc_bits_num)) & 0x0F);
-        proc_bits_num += 9;
-    }
-    else if (offset_5_bits == 12 || offset_5_bits == 13)
-    {
-        offset = offset_5_bits * 32 - 319 + ((proc_buffer >> (22 - proc_bits_num)) & 0x1F);
-        proc_bits_num += 10;
-    }
-    else if (offset_5_bits == 14 || offset_5_bits == 15)
-    {
-        offset = offset_5_bits * 64 - 767 + ((proc_buffer >> (21 - proc_bits_num)) & 0x3F);
-        proc_bits_num += 11;
-    }
-    else if (offset_5_bits == 16 || offset_5_bits == 17)
-    {
-        offset = offset_5_bits * 128 - 1791 + ((proc_buffer >> (20 - proc_bits_num)) & 0x7F);
-        proc_bits_num += 12;
-    }
-    else if (offset_5_bits == 18 || offset_5_bits == 19)
-    {
-        offset = offset_5_bits * 256 - 4095 + ((proc_buffer >> (19 - proc_bits_num)) & 0x0FF);
-        proc_bits_num += 13;
-    }
-    else if (offset_5_bits == 20 || offset_5_bits == 21)
-    {
-        offset = offset_5_bits * 512 - 9215 + ((proc_buffer >> (18 - proc_bits_num)) & 0x1FF);
-        proc_bits_num += 14;
-    }
-    else if (offset_5_bits == 22 || offset_5_bits == 23)
-    {
-        offset = offset_5_bits * 1024 - 20479 + ((proc_buffer >> (17 - proc_bits_num)) & 0x3FF);
-        proc_bits_num += 15;
-    }
-    else
-    {
-        // Currently not possible to enter here (4097-32768)
-        cout << "Wrong! Offset decoding is wrong!" << endl;
-        cout << "Enter infinite loop to pause" << endl;
-    }
-
-    return offset;
+    return space;
 }
 
-void LZ77_decoder(uint8_t input[3000], hls::stream<uint32_t> &output)
+void LZ77_decoder(hls::stream<uint32_t> &input, hls::stream<axi_word> &output, unsigned format,
+                  unsigned &status, unsigned &size, unsigned perf[PERF_NUM])
 {
 
-    int curr = 0;
     int output_pos = 0;
     int matching_start_pos = 0;
     int offset = 0;
-    uint8_t output_array[3000];
-    uint32_t output_word;
+    int length = 0;
+    uint8_t output_array[MAX_JOB_SIZE + STREAM_BYTES]; // read one output word per cycle
+#pragma HLS ARRAY_PARTITION variable = output_array cyclic factor = STREAM_BYTES dim = 1
+    stream_data_t output_word;
+    uint32_t token;
+    uint32_t expected_checksum = 0, expected_size = 0; // trailer of the container
+    checksum_state checksum;
+    unsigned errors = INFLATE_OK;
+    perf_counters counters;
+
+    counters.lz77_cycles = 0;
+    counters.output_stalls = 0;
+    counters.matches = 0;
+    counters.literals = 0;
+
+    input.read(token);
 
 LZ77_MAIN_LOOP:
-    while (input[curr] != '\0')
+    while ((token & TOKEN_TYPE) != TOKEN_END)
     {
 #pragma HLS PIPELINE
+        counters.lz77_cycles++;
+        MODEL_ITERATION(MODEL_LZ77_MAIN_LOOP);
+
         // Meet the compressed sequence
-        if (input[curr] == '@')
+        if ((token & TOKEN_TYPE) == TOKEN_MATCH)
         {
-            offset = (input[curr + 1] * 128) + input[curr + 2];
+            counters.matches++;
+            offset = token & 0xFFFF;
+            length = (token >> 16) & 0x1FF;
             matching_start_pos = output_pos - offset;
 
+            if (matching_start_pos < 0 || output_pos + length > MAX_JOB_SIZE)
+            {
+                // the distance is too far back, or the job is too large; drop the match
+                errors |= INFLATE_DATA_ERROR;
+                length = 0;
+            }
+
         COPY_MATCHED_CHAR:
-            for (int i = 0; i < (input[curr + 3]); i++)
+            for (int i = 0; i < length; i++)
             {
 #pragma HLS PIPELINE
                 output_array[output_pos++] = output_array[matching_start_pos++];
+                counters.lz77_cycles++;
+                MODEL_ITERATION(MODEL_COPY_MATCHED_CHAR);
             }
-            curr += 4;
         }
-        else
+        else if (output_pos < MAX_JOB_SIZE)
         {
             // Meet a literal
-            output_array[output_pos] = input[curr];
+            output_array[output_pos] = token & 0xFF;
             output_pos++;
-            curr++;
+            counters.literals++;
         }
+        else
+        {
+            errors |= INFLATE_DATA_ERROR;
+        }
+
+        input.read(token);
     }
-    output_array[output_pos] = '\0';
 
-    // store output_array data into output stream
-    int copy_count = (output_pos + 1) / 4;
-    copy_count++;
+    // pad the last word with zeros
+PAD_LAST_WORD:
+    for (int i = 0; i < STREAM_BYTES; i++)
+    {
+#pragma HLS UNROLL
+        output_array[output_pos + i] = 0;
+    }
+
+    // errors of the Huffman decoder, then the trailer unless there was a data error
+    errors |= token & 0x3;
+    bool has_trailer = format != FORMAT_RAW && !(token & INFLATE_DATA_ERROR);
+
+    if (has_trailer && format == FORMAT_ZLIB)
+    {
+        input.read(expected_checksum);
+    }
+    else if (has_trailer && format == FORMAT_GZIP)
+    {
+        input.read(expected_checksum);
+        input.read(expected_size);
+    }
+
+    // the counters of the Huffman decoder and stream_unpack
+    input.read(counters.huffman_cycles);
+    input.read(counters.bytes_in);
+    input.read(counters.input_stalls);
+
+    checksum_init(checksum);
+
+    // store output_array data into output stream, an empty job still sends one word with TLAST
+    int copy_count = output_pos == 0 ? 1 : (output_pos + STREAM_BYTES - 1) / STREAM_BYTES;
 
 LZ77_OUTPUT:
     for (int i = 0; i < copy_count; i++)
     {
 #pragma HLS PIPELINE
-        output_word = (output_array[i * 4] << 24) | (output_array[i * 4 + 1] << 16) | (output_array[i * 4 + 2] << 8) | (output_array[i * 4 + 3]);
-        output.write(output_word);
+        // pack STREAM_BYTES bytes, the first at the top
+        output_word = 0;
+    PACK_OUTPUT_WORD:
+        for (int k = 0; k < STREAM_BYTES; k++)
+        {
+#pragma HLS UNROLL
+            output_word = (output_word << 8) | output_array[i * STREAM_BYTES + k];
+        }
+        int valid_bytes = output_pos - i * STREAM_BYTES;
+        valid_bytes = valid_bytes >= STREAM_BYTES ? STREAM_BYTES : valid_bytes > 0 ? valid_bytes : 0;
+
+        if (output.full())
+            counters.output_stalls++; // the write below waits for the output
+        output.write(make_axi_word(output_word, valid_bytes, i == copy_count - 1));
+        counters.lz77_cycles++;
+        MODEL_ITERATION(MODEL_LZ77_OUTPUT);
+
+        // checksums of the decompressed bytes, computed as the words go out
+        checksum_update(checksum, output_word, valid_bytes);
     }
 
+    if (has_trailer && format == FORMAT_ZLIB && checksum_adler32(checksum) != expected_checksum)
+        errors |= INFLATE_CHECKSUM_ERROR;
+    if (has_trailer && format == FORMAT_GZIP && (checksum_crc32(checksum) != expected_checksum || checksum.size != expected_size))
+        errors |= INFLATE_CHECKSUM_ERROR;
+
+    status = errors;
+    size = output_pos;
+
+    counters.bytes_out = output_pos;
+    perf_export(counters, perf);
+
     //    // print out the result - for testing
     //    int out = 0;
     //    cout << endl << "The stream after LZ77 decoding: " << endl << endl;
-    //    while (output_array[out] != '\0') {
+    //    while (out < output_pos) {
     //        cout << output_array[out++];
     //    }
     //    cout << endl;
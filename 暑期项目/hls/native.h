@@ -0,0 +1,441 @@
+/*
+ * File:   native.h
+ *
+ * Plain C++ stand-ins for the HLS types, for the native build of the cores.
+ */
+
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <type_traits>
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#ifdef DEFLATE_THREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+/*
+ * With DEFLATE_NATIVE defined, deflate.h includes this file instead of the
+ * HLS headers, and the same sources build as a normal library, for a CPU
+ * fallback codec and for fast regressions:
+ *
+ *     g++ -O3 -Wno-unknown-pragmas -DDEFLATE_NATIVE [-DSTREAM_WIDTH=64] -c deflate.cpp inflate.cpp checksum.cpp codec.cpp
+ *     ar rcs libdeflate.a deflate.o inflate.o checksum.o codec.o
+ *
+ * 1. ap_uint<N> is the smallest native unsigned integer of at least N bits
+ * (unsigned __int128 for a 128-bit stream). It does not wrap at N bits; the
+ * cores mask their fields where the width matters.
+ * 2. ap_axiu has the same fields as the HLS one, as plain integers.
+ * 3. hls::stream is an unbounded lock-free single-producer/single-consumer
+ * FIFO, so a stream can hold a whole job.
+ * 4. The stages of a DATAFLOW region are called through dataflow_run(). They
+ * run one after the other, as in C simulation, or each on its own thread
+ * with -DDEFLATE_THREADS (add -pthread).
+ * 5. The byte compares and the dictionary lookups of the LZ77 search run on
+ * SIMD registers (native_match_length(), native_dict_lookup()); build with
+ * -march=native for AVX2 and AVX-512.
+ *
+ * The HLS pragmas are ignored (-Wno-unknown-pragmas), and the cycle model
+ * of C simulation is left out (MODEL_ITERATION is empty, MODEL_ENABLED is 0):
+ * model_report() and the benchmark print no cycles instead of zeros.
+ */
+
+// The loop labels only name the loops for the HLS directives
+#pragma GCC diagnostic ignored "-Wunused-label"
+
+template <int N>
+struct native_uint
+{
+    typedef typename std::conditional<
+        N <= 8, uint8_t,
+        typename std::conditional<
+            N <= 16, uint16_t,
+            typename std::conditional<N <= 32, uint32_t,
+                                      typename std::conditional<N <= 64, uint64_t, unsigned __int128>::type>::type>::
+            type>::type type;
+};
+
+template <int N>
+using ap_uint = typename native_uint<N>::type;
+
+template <int D, int U, int TI, int TD>
+struct ap_axiu
+{
+    ap_uint<D> data;
+    ap_uint<(D + 7) / 8> keep;
+    ap_uint<(D + 7) / 8> strb;
+    ap_uint<U> user;
+    ap_uint<1> last;
+    ap_uint<TI> id;
+    ap_uint<TD> dest;
+};
+
+namespace hls
+{
+
+/*
+ * Unbounded single-producer/single-consumer FIFO, lock-free: a list of
+ * chunks of NATIVE_CHUNK entries. The producer links a new chunk when its
+ * chunk is full; the consumer frees a chunk once it has read past it. The
+ * entries written and read are counted in two atomics, so empty() and
+ * size() are safe from either side.
+ *
+ * A read of an empty stream waits for the producer with DEFLATE_THREADS;
+ * without threads no producer can run, so it aborts instead of hanging.
+ */
+#define NATIVE_CHUNK 256
+
+template <typename T>
+class stream
+{
+  public:
+    stream() : head(new chunk), tail(head), written(0), consumed(0) {}
+    explicit stream(const char *name) : head(new chunk), tail(head), written(0), consumed(0) {}
+    ~stream()
+    {
+        while (head != NULL)
+        {
+            chunk *next = head->next;
+            delete head;
+            head = next;
+        }
+    }
+
+    bool empty() const { return consumed.load(std::memory_order_relaxed) == written.load(std::memory_order_acquire); }
+    bool full() const { return false; }
+    size_t size() const { return written.load(std::memory_order_acquire) - consumed.load(std::memory_order_acquire); }
+
+    void read(T &value)
+    {
+        size_t position = consumed.load(std::memory_order_relaxed);
+        while (position == written.load(std::memory_order_acquire))
+        {
+#ifdef DEFLATE_THREADS
+            std::this_thread::yield();
+#else
+            // the hardware would wait forever
+            std::cerr << "hls::stream read while empty" << std::endl;
+            abort();
+#endif
+        }
+        if (position % NATIVE_CHUNK == 0 && position != 0)
+        {
+            // the producer linked the next chunk before publishing this entry
+            chunk *next = head->next;
+            delete head;
+            head = next;
+        }
+        value = head->entries[position % NATIVE_CHUNK];
+        consumed.store(position + 1, std::memory_order_release);
+    }
+    T read()
+    {
+        T value;
+        read(value);
+        return value;
+    }
+    bool read_nb(T &value)
+    {
+        if (empty())
+            return false;
+        read(value);
+        return true;
+    }
+
+    void write(const T &value)
+    {
+        size_t position = written.load(std::memory_order_relaxed);
+        if (position % NATIVE_CHUNK == 0 && position != 0)
+        {
+            chunk *next = new chunk;
+            tail->next = next;
+            tail = next;
+        }
+        tail->entries[position % NATIVE_CHUNK] = value;
+        written.store(position + 1, std::memory_order_release);
+    }
+    bool write_nb(const T &value)
+    {
+        write(value);
+        return true;
+    }
+
+    void operator>>(T &value) { read(value); }
+    void operator<<(const T &value) { write(value); }
+
+  private:
+    stream(const stream &);
+    stream &operator=(const stream &);
+
+    struct chunk
+    {
+        chunk() : next(NULL) {}
+        T entries[NATIVE_CHUNK];
+        chunk *next;
+    };
+
+    chunk *head; // the consumer side
+    chunk *tail; // the producer side
+    std::atomic<size_t> written;
+    std::atomic<size_t> consumed;
+};
+
+} // namespace hls
+
+/*
+ * Run the stages of a DATAFLOW region. With DEFLATE_THREADS, each stage but
+ * the last runs on a worker thread, the last on the calling thread, and the
+ * call returns when all are done; the stages then overlap like the hardware
+ * stages, through the streams between them. The workers are created once
+ * per calling thread and kept for the next region. Without threads, the
+ * stages run one after the other, as in C simulation.
+ */
+#define NATIVE_MAX_STAGES 4
+
+#ifdef DEFLATE_THREADS
+class dataflow_worker
+{
+  public:
+    dataflow_worker() : busy(false), stop(false), thread(&dataflow_worker::loop, this) {}
+    ~dataflow_worker()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        ready.notify_all();
+        thread.join();
+    }
+
+    void post(const std::function<void()> &stage)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = stage;
+        busy = true;
+        ready.notify_all();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ready.wait(lock, [this] { return !busy; });
+    }
+
+  private:
+    void loop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            ready.wait(lock, [this] { return busy || stop; });
+            if (stop)
+                return;
+            lock.unlock();
+            task();
+            lock.lock();
+            busy = false;
+            ready.notify_all();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::function<void()> task;
+    bool busy;
+    bool stop;
+    std::thread thread; // last, started once the members above are set
+};
+#endif
+
+inline void dataflow_run(std::initializer_list<std::function<void()>> stages)
+{
+#ifdef DEFLATE_THREADS
+    static thread_local dataflow_worker workers[NATIVE_MAX_STAGES - 1];
+    const std::function<void()> *stage = stages.begin();
+    size_t count = stages.size();
+
+    for (size_t i = 0; i + 1 < count; i++)
+    {
+        workers[i].post(stage[i]);
+    }
+    stage[count - 1]();
+    for (size_t i = 0; i + 1 < count; i++)
+    {
+        workers[i].wait();
+    }
+#else
+    for (const std::function<void()> &stage : stages)
+    {
+        stage();
+    }
+#endif
+}
+
+/*
+ * Number of equal leading bytes of a and b, at most max_length: the match
+ * length that COMPARE_EACH_CHAR counts one byte at a time. The bytes are
+ * compared 32 (AVX2) or 16 (SSE2, NEON) at a time into a mask of the equal
+ * bytes, and the first zero bit of the mask is the length. Then 8 bytes at a
+ * time in a 64-bit word, and the tail byte by byte.
+ */
+inline int native_match_length(const uint8_t *a, const uint8_t *b, int max_length)
+{
+    int length = 0;
+
+#if defined(__AVX2__)
+    for (; length + 32 <= max_length; length += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + length));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + length));
+        uint32_t differ = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        if (differ != 0)
+            return length + __builtin_ctz(differ);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; length + 16 <= max_length; length += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + length));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + length));
+        uint32_t differ = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) & 0xFFFF;
+        if (differ != 0)
+            return length + __builtin_ctz(differ);
+    }
+#elif defined(__ARM_NEON)
+    for (; length + 16 <= max_length; length += 16)
+    {
+        uint8x16_t equal = vceqq_u8(vld1q_u8(a + length), vld1q_u8(b + length));
+        // no movemask on NEON: narrow each byte of the compare to 4 bits of a 64-bit mask
+        uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(equal), 4);
+        uint64_t differ = ~vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+        if (differ != 0)
+            return length + (__builtin_ctzll(differ) >> 2);
+    }
+#endif
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; length + 8 <= max_length; length += 8)
+    {
+        uint64_t x, y;
+        __builtin_memcpy(&x, a + length, 8);
+        __builtin_memcpy(&y, b + length, 8);
+        if (x != y)
+            return length + (__builtin_ctzll(x ^ y) >> 3); // the first byte is the low byte
+    }
+#endif
+    for (; length < max_length; length++)
+    {
+        if (a[length] != b[length])
+            return length;
+    }
+
+    return max_length;
+}
+
+/*
+ * The dictionary lookups and updates of one iteration of the LZ77 search,
+ * four lanes of four dictionaries. Lane i reads row hash[i] of 'table': the
+ * positions of the entries of its hash value, then their keys, in one cache
+ * line. The entry of dictionary t is found if its position - base is below
+ * limit + i, unsigned; then string_pos[4 * i + t] and string_key[4 * i + t]
+ * take it (position - base), else they keep their string. Returns the entries found
+ * as bits 4 * i + t, and sets the bits of the strings whose key is key[i] in
+ * 'equal'. Only the low 24 bits of the keys are compared; the caller keeps
+ * its own data in their top 8 bits.
+ * After all the lookups, entry i of row hash[i] takes position + i and key[i].
+ * AVX-512 does the 16 lookups at once, SSE2 and NEON (AArch64) a lane at a
+ * time.
+ */
+inline unsigned native_dict_lookup(uint32_t table[][2][4], const uint16_t hash[4],
+                                   uint32_t base, uint32_t limit, uint32_t position, const uint32_t key[4],
+                                   uint32_t string_pos[16], uint32_t string_key[16], unsigned &equal)
+{
+    unsigned found_all = 0;
+
+#if defined(__AVX512F__)
+    const __m512i lane = _mm512_set_epi32(3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0);
+    __m512i entry_pos = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)table[hash[0]][0]));
+    __m512i entry_key = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)table[hash[0]][1]));
+    entry_pos = _mm512_inserti32x4(entry_pos, _mm_loadu_si128((const __m128i *)table[hash[1]][0]), 1);
+    entry_key = _mm512_inserti32x4(entry_key, _mm_loadu_si128((const __m128i *)table[hash[1]][1]), 1);
+    entry_pos = _mm512_inserti32x4(entry_pos, _mm_loadu_si128((const __m128i *)table[hash[2]][0]), 2);
+    entry_key = _mm512_inserti32x4(entry_key, _mm_loadu_si128((const __m128i *)table[hash[2]][1]), 2);
+    entry_pos = _mm512_inserti32x4(entry_pos, _mm_loadu_si128((const __m128i *)table[hash[3]][0]), 3);
+    entry_key = _mm512_inserti32x4(entry_key, _mm_loadu_si128((const __m128i *)table[hash[3]][1]), 3);
+    entry_pos = _mm512_sub_epi32(entry_pos, _mm512_set1_epi32(base));
+    __mmask16 found = _mm512_cmplt_epu32_mask(entry_pos, _mm512_add_epi32(_mm512_set1_epi32(limit), lane));
+    __m512i strings = _mm512_mask_mov_epi32(_mm512_loadu_si512(string_key), found, entry_key);
+
+    _mm512_storeu_si512(string_pos, _mm512_mask_mov_epi32(_mm512_loadu_si512(string_pos), found, entry_pos));
+    _mm512_storeu_si512(string_key, strings);
+    __m512i keys = _mm512_permutexvar_epi32(lane, _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)key)));
+    equal = _mm512_testn_epi32_mask(_mm512_xor_si512(strings, keys), _mm512_set1_epi32(0xFFFFFF));
+    found_all = found;
+#else
+    equal = 0;
+    for (int i = 0; i < 4; i++)
+    {
+#if defined(__SSE2__)
+        // no unsigned compare: flip the sign bits
+        const __m128i sign = _mm_set1_epi32((int)0x80000000);
+        __m128i entry_pos = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)table[hash[i]][0]), _mm_set1_epi32(base));
+        __m128i found = _mm_cmplt_epi32(_mm_xor_si128(entry_pos, sign), _mm_set1_epi32((limit + i) ^ 0x80000000));
+        __m128i old_pos = _mm_loadu_si128((const __m128i *)&string_pos[4 * i]);
+        __m128i old_key = _mm_loadu_si128((const __m128i *)&string_key[4 * i]);
+        __m128i strings = _mm_or_si128(_mm_and_si128(found, _mm_loadu_si128((const __m128i *)table[hash[i]][1])),
+                                       _mm_andnot_si128(found, old_key));
+
+        _mm_storeu_si128((__m128i *)&string_pos[4 * i], _mm_or_si128(_mm_and_si128(found, entry_pos), _mm_andnot_si128(found, old_pos)));
+        _mm_storeu_si128((__m128i *)&string_key[4 * i], strings);
+        found_all |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(found)) << (4 * i);
+        __m128i low = _mm_and_si128(strings, _mm_set1_epi32(0xFFFFFF));
+        equal |= (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(low, _mm_set1_epi32(key[i] & 0xFFFFFF)))) << (4 * i);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        const uint32x4_t bit = {1, 2, 4, 8};
+        uint32x4_t entry_pos = vsubq_u32(vld1q_u32(table[hash[i]][0]), vdupq_n_u32(base));
+        uint32x4_t found = vcltq_u32(entry_pos, vdupq_n_u32(limit + i));
+        uint32x4_t strings = vbslq_u32(found, vld1q_u32(table[hash[i]][1]), vld1q_u32(&string_key[4 * i]));
+
+        vst1q_u32(&string_pos[4 * i], vbslq_u32(found, entry_pos, vld1q_u32(&string_pos[4 * i])));
+        vst1q_u32(&string_key[4 * i], strings);
+        found_all |= vaddvq_u32(vandq_u32(found, bit)) << (4 * i);
+        uint32x4_t low = vandq_u32(strings, vdupq_n_u32(0xFFFFFF));
+        equal |= vaddvq_u32(vandq_u32(vceqq_u32(low, vdupq_n_u32(key[i] & 0xFFFFFF)), bit)) << (4 * i);
+#else
+        for (int t = 0; t < 4; t++)
+        {
+            uint32_t entry_pos = table[hash[i]][0][t] - base;
+            if (entry_pos < limit + i)
+            {
+                string_pos[4 * i + t] = entry_pos;
+                string_key[4 * i + t] = table[hash[i]][1][t];
+                found_all |= 1u << (4 * i + t);
+            }
+            equal |= (unsigned)(((string_key[4 * i + t] ^ key[i]) & 0xFFFFFF) == 0) << (4 * i + t);
+        }
+#endif
+    }
+#endif
+
+    for (int i = 0; i < 4; i++)
+    {
+        table[hash[i]][0][i] = position + i;
+        table[hash[i]][1][i] = key[i];
+    }
+
+    return found_all;
+}
+
+#endif /* NATIVE_H */
@@ -0,0 +1,433 @@
+/*
+ * File:   parallel.cpp
+ *
+ * Parallel compression of large data over CPU cores and accelerators, and
+ * parallel decompression of its output.
+ */
+
+#include "host.h"
+#include "stream_io.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*
+ * The data is cut into jobs of MAX_JOB_SIZE bytes, as for one core, and the
+ * jobs are compressed at once by a pool of workers, one thread each. The
+ * workers take the next job from a shared counter until none are left, so a
+ * faster worker (an accelerator, an idle CPU core) takes more jobs.
+ *
+ * Each job is compressed with FORMAT_SYNC_FLUSH: a block that is not the
+ * last one, followed by an empty stored block, so it ends on a byte
+ * boundary. The jobs do not refer to one another, so their outputs are
+ * simply put one after the other, as pigz does. The first job writes the
+ * header of the container. Then comes the last block, static and empty, and
+ * the trailer, with the checksums of the whole data, computed by the calling
+ * thread while the workers run.
+ *
+ * The output is the same for any number and kind of workers.
+ *
+ * As the jobs are independent, they can be inflated at once too, given where
+ * each one starts: the block index. parallel_deflate returns it, and with
+ * FORMAT_BLOCK_INDEX writes it after a gzip stream, in the FEXTRA field of
+ * an empty gzip member. gzip decoders read all the members, so they give the
+ * same data. The member is:
+ *
+ *     1f 8b 08 04 | MTIME 0 | XFL 0 | OS ff | XLEN | 'B' 'I' | LEN | index | 03 00 | CRC-32 0 | ISIZE 0
+ *
+ * and the index, little endian as gzip:
+ *
+ *     job size (4 bytes) | size of the last job (4) | compressed bytes of each job (2 each)
+ *
+ * The compressed bytes of the first job count the header. The index of over
+ * MAX_INDEXED_JOBS jobs does not fit in FEXTRA and is left out; it can still
+ * be kept in a file of its own (save_block_index(), 'B' 'I' then the index),
+ * for any container.
+ *
+ * Each job is also an access point for random access: inflate_range()
+ * inflates only the jobs that hold the bytes asked for. No window has to be
+ * kept with the access points, as no job refers to the data before it.
+ */
+
+// The last block of the stream: BFINAL = 1, BTYPE = 01, end-of-block code
+static const uint8_t LAST_BLOCK[2] = {0x03, 0x00};
+
+// Block index member: header up to XLEN, subfield header, index header
+#define INDEX_HEADER_BYTES 10
+#define INDEX_SUBFIELD_BYTES 4
+#define INDEX_FIXED_BYTES 8
+#define INDEX_MEMBER_BYTES (INDEX_HEADER_BYTES + 2 + INDEX_SUBFIELD_BYTES + 2 + 8) // and the index
+#define MAX_INDEXED_JOBS ((65535 - INDEX_SUBFIELD_BYTES - INDEX_FIXED_BYTES) / 2)
+
+chunk_worker cpu_worker()
+{
+    return [](const uint8_t *data, unsigned size, unsigned format, uint8_t *out) -> unsigned {
+        hls::stream<axi_word> input, output;
+        unsigned perf[PERF_NUM];
+
+        send_bytes(input, data, size);
+        Deflate(input, output, format, size, perf);
+        return receive_bytes(output, out);
+    };
+}
+
+/*
+ * An accelerator instance runs one job at a time: the host loads the
+ * registers of the Codec top level, sends the job and receives the output
+ * up to TLAST. The stand-in does the same with the Codec function, in
+ * software; a driver of a real instance takes its place in the pool.
+ */
+chunk_worker accelerator_stand_in()
+{
+    std::shared_ptr<std::mutex> instance(new std::mutex);
+
+    return [instance](const uint8_t *data, unsigned size, unsigned format, uint8_t *out) -> unsigned {
+        std::lock_guard<std::mutex> lock(*instance);
+        hls::stream<axi_word> input, output;
+        unsigned perf[PERF_NUM];
+        unsigned status;
+
+        send_bytes(input, data, size);
+        Codec(input, output, OP_DEFLATE, format, size, status, perf);
+        return receive_bytes(output, out);
+    };
+}
+
+std::vector<chunk_worker> make_workers(unsigned cpus, unsigned accelerators)
+{
+    std::vector<chunk_worker> workers;
+
+    if (cpus == 0)
+        cpus = std::thread::hardware_concurrency() == 0 ? 1 : std::thread::hardware_concurrency();
+    for (unsigned i = 0; i < cpus; i++)
+        workers.push_back(cpu_worker());
+    for (unsigned i = 0; i < accelerators; i++)
+        workers.push_back(accelerator_stand_in());
+
+    return workers;
+}
+
+// Add bytes to the checksums, STREAM_BYTES bytes per word as the core reads them
+static void checksum_bytes(checksum_state &checksum, const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; i += STREAM_BYTES)
+    {
+        stream_data_t word = 0;
+        unsigned valid_bytes = 0;
+        for (int k = 0; k < STREAM_BYTES; k++)
+        {
+            word = (word << 8) | (i + k < size ? data[i + k] : 0);
+            valid_bytes += i + k < size;
+        }
+        checksum_update(checksum, word, valid_bytes);
+    }
+}
+
+// Little-endian fields of the block index
+static void put_le(std::vector<uint8_t> &stream, uint32_t value, int bytes)
+{
+    for (int k = 0; k < bytes; k++)
+        stream.push_back(value >> (8 * k));
+}
+
+static uint32_t get_le(const uint8_t *bytes, int count)
+{
+    uint32_t value = 0;
+    for (int k = count - 1; k >= 0; k--)
+        value = (value << 8) | bytes[k];
+    return value;
+}
+
+// The index in the layout above, without the member
+static void put_index(std::vector<uint8_t> &bytes, const block_index &index)
+{
+    size_t chunks = index.offsets.size();
+
+    put_le(bytes, index.job_size, 4);
+    put_le(bytes, index.data_size - (chunks - 1) * index.job_size, 4);
+    for (size_t chunk = 0; chunk < chunks; chunk++)
+        put_le(bytes, (chunk + 1 < chunks ? index.offsets[chunk + 1] : index.end) - index.offsets[chunk], 2);
+}
+
+static bool get_index(const uint8_t *bytes, size_t length, block_index &index)
+{
+    size_t chunks = (length - INDEX_FIXED_BYTES) / 2;
+    if (length < INDEX_FIXED_BYTES + 2 || (length - INDEX_FIXED_BYTES) % 2 != 0)
+        return false;
+
+    index.job_size = get_le(bytes, 4);
+    unsigned last_size = get_le(bytes + 4, 4);
+    if (index.job_size == 0 || index.job_size > MAX_JOB_SIZE || last_size > index.job_size ||
+        (last_size == 0 && chunks > 1))
+        return false;
+
+    index.data_size = (chunks - 1) * index.job_size + last_size;
+    index.offsets.clear();
+    index.end = 0;
+    for (size_t chunk = 0; chunk < chunks; chunk++)
+    {
+        index.offsets.push_back(index.end);
+        index.end += get_le(bytes + INDEX_FIXED_BYTES + 2 * chunk, 2);
+    }
+
+    return true;
+}
+
+std::vector<uint8_t> parallel_deflate(const uint8_t *data, size_t size, unsigned format,
+                                      const std::vector<chunk_worker> &workers, block_index *index)
+{
+    unsigned container = format & FORMAT_CONTAINER;
+    size_t chunks = size == 0 ? 1 : (size + MAX_JOB_SIZE - 1) / MAX_JOB_SIZE;
+    std::vector<std::vector<uint8_t>> pieces(chunks);
+    std::atomic<size_t> next_chunk(0);
+    std::vector<std::thread> threads;
+    checksum_state checksum;
+
+    for (const chunk_worker &worker : workers)
+    {
+        threads.push_back(std::thread([&, worker] {
+            for (size_t chunk = next_chunk++; chunk < chunks; chunk = next_chunk++)
+            {
+                size_t start = chunk * MAX_JOB_SIZE;
+                unsigned job_size = size - start < MAX_JOB_SIZE ? size - start : MAX_JOB_SIZE;
+                // the header with the first job only
+                unsigned job_format = (chunk == 0 ? container : FORMAT_RAW) | FORMAT_SYNC_FLUSH;
+
+                pieces[chunk].resize(JOB_OUTPUT_BOUND);
+                pieces[chunk].resize(worker(data + start, job_size, job_format, pieces[chunk].data()));
+            }
+        }));
+    }
+
+    checksum_init(checksum);
+    checksum_bytes(checksum, data, size);
+
+    for (std::thread &thread : threads)
+        thread.join();
+
+    // stitch the jobs, then the last block and the trailer
+    std::vector<uint8_t> stream;
+    block_index jobs;
+    jobs.job_size = MAX_JOB_SIZE;
+    jobs.data_size = size;
+    for (size_t chunk = 0; chunk < chunks; chunk++)
+    {
+        jobs.offsets.push_back(stream.size());
+        stream.insert(stream.end(), pieces[chunk].begin(), pieces[chunk].end());
+    }
+    jobs.end = stream.size();
+    stream.insert(stream.end(), LAST_BLOCK, LAST_BLOCK + sizeof(LAST_BLOCK));
+
+    if (container == FORMAT_ZLIB)
+    {
+        // Adler-32, MSB first
+        uint32_t adler = checksum_adler32(checksum);
+        for (int k = 3; k >= 0; k--)
+            stream.push_back(adler >> (8 * k));
+    }
+    else if (container == FORMAT_GZIP)
+    {
+        // CRC-32 and ISIZE, LSB first
+        put_le(stream, checksum_crc32(checksum), 4);
+        put_le(stream, checksum.size, 4);
+    }
+
+    if ((format & FORMAT_BLOCK_INDEX) && container == FORMAT_GZIP && chunks <= MAX_INDEXED_JOBS)
+    {
+        static const uint8_t INDEX_HEADER[INDEX_HEADER_BYTES] = {0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff};
+        unsigned length = INDEX_FIXED_BYTES + 2 * chunks;
+
+        stream.insert(stream.end(), INDEX_HEADER, INDEX_HEADER + INDEX_HEADER_BYTES);
+        put_le(stream, INDEX_SUBFIELD_BYTES + length, 2); // XLEN
+        stream.push_back('B');
+        stream.push_back('I');
+        put_le(stream, length, 2);
+        put_index(stream, jobs);
+        stream.insert(stream.end(), LAST_BLOCK, LAST_BLOCK + sizeof(LAST_BLOCK));
+        put_le(stream, 0, 4); // CRC-32 of no data
+        put_le(stream, 0, 4);
+    }
+
+    if (index != NULL)
+        *index = jobs;
+
+    return stream;
+}
+
+bool read_block_index(const uint8_t *stream, size_t size, block_index &index)
+{
+    // the member ends the stream, so its start follows from the number of jobs
+    for (size_t chunks = 1; chunks <= MAX_INDEXED_JOBS; chunks++)
+    {
+        size_t length = INDEX_FIXED_BYTES + 2 * chunks;
+        if (size < INDEX_MEMBER_BYTES + length)
+            return false;
+
+        const uint8_t *member = stream + size - INDEX_MEMBER_BYTES - length;
+        const uint8_t *field = member + INDEX_HEADER_BYTES + 2 + INDEX_SUBFIELD_BYTES;
+        if (member[0] != 0x1f || member[1] != 0x8b || member[2] != 0x08 || member[3] != 0x04 ||
+            get_le(member + INDEX_HEADER_BYTES, 2) != INDEX_SUBFIELD_BYTES + length ||
+            member[INDEX_HEADER_BYTES + 2] != 'B' || member[INDEX_HEADER_BYTES + 3] != 'I' ||
+            get_le(member + INDEX_HEADER_BYTES + 4, 2) != length)
+            continue;
+
+        if (!get_index(field, length, index))
+            return false;
+
+        // the gzip stream: the jobs, the last block and the trailer
+        return index.end + sizeof(LAST_BLOCK) + TRAILER_BYTES[FORMAT_GZIP] == (size_t)(member - stream);
+    }
+
+    return false;
+}
+
+std::vector<uint8_t> save_block_index(const block_index &index)
+{
+    std::vector<uint8_t> bytes;
+
+    bytes.push_back('B');
+    bytes.push_back('I');
+    put_index(bytes, index);
+
+    return bytes;
+}
+
+bool load_block_index(const uint8_t *bytes, size_t size, block_index &index)
+{
+    return size >= 2 && bytes[0] == 'B' && bytes[1] == 'I' && get_index(bytes + 2, size - 2, index);
+}
+
+// Check the index and the header of a stream; INFLATE_OK or an INFLATE_* error
+static unsigned check_index(const uint8_t *stream, size_t size, unsigned container, const block_index &index)
+{
+    size_t chunks = index.offsets.size();
+
+    if (chunks == 0 || index.job_size == 0 || index.job_size > MAX_JOB_SIZE ||
+        index.data_size > chunks * index.job_size ||
+        (index.data_size + index.job_size <= chunks * index.job_size && !(index.data_size == 0 && chunks == 1)) ||
+        index.end + sizeof(LAST_BLOCK) + TRAILER_BYTES[container] > size ||
+        index.offsets[0] + HEADER_BYTES[container] > index.end)
+        return INFLATE_DATA_ERROR;
+
+    // the header, as the cores write it
+    const uint8_t *header = stream + index.offsets[0];
+    if ((container == FORMAT_ZLIB && ((header[0] & 0x0F) != 8 || (header[0] << 8 | header[1]) % 31 != 0)) ||
+        (container == FORMAT_GZIP && (header[0] != 0x1f || header[1] != 0x8b || header[2] != 0x08 || header[3] != 0)))
+        return INFLATE_HEADER_ERROR;
+
+    return INFLATE_OK;
+}
+
+// Inflate the jobs first to last - 1 into 'data', job 'first' at the start,
+// on 'threads' threads; returns INFLATE_OK or INFLATE_* errors ORed
+static unsigned inflate_jobs(const uint8_t *stream, unsigned container, const block_index &index, size_t first,
+                             size_t last, unsigned threads, uint8_t *data)
+{
+    size_t chunks = index.offsets.size();
+    std::atomic<size_t> next_chunk(first);
+    std::atomic<unsigned> errors(INFLATE_OK);
+    std::vector<std::thread> pool;
+
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency() == 0 ? 1 : std::thread::hardware_concurrency();
+    if (threads > last - first)
+        threads = last - first;
+
+    for (unsigned t = 0; t < threads; t++)
+    {
+        pool.push_back(std::thread([&] {
+            for (size_t chunk = next_chunk++; chunk < last; chunk = next_chunk++)
+            {
+                // the job, without the header, and the last block to end it
+                size_t start = index.offsets[chunk] + (chunk == 0 ? HEADER_BYTES[container] : 0);
+                size_t stop = chunk + 1 < chunks ? index.offsets[chunk + 1] : index.end;
+                size_t job_start = chunk * index.job_size;
+                unsigned job_size = index.data_size - job_start < index.job_size ? index.data_size - job_start
+                                                                                 : index.job_size;
+                if (stop < start)
+                {
+                    errors |= INFLATE_DATA_ERROR;
+                    continue;
+                }
+                std::vector<uint8_t> job(stream + start, stream + stop);
+                job.insert(job.end(), LAST_BLOCK, LAST_BLOCK + sizeof(LAST_BLOCK));
+
+                hls::stream<axi_word> input, output;
+                uint8_t out[MAX_JOB_SIZE + STREAM_BYTES];
+                unsigned perf[PERF_NUM];
+                unsigned job_status, out_size;
+
+                send_bytes(input, job.data(), job.size());
+                inflate(input, output, FORMAT_RAW, job_status, out_size, perf);
+                receive_bytes(output, out);
+
+                if (job_status != INFLATE_OK || out_size != job_size)
+                    errors |= job_status | INFLATE_DATA_ERROR;
+                else
+                    std::copy(out, out + job_size, data + (chunk - first) * index.job_size);
+            }
+        }));
+    }
+
+    for (std::thread &thread : pool)
+        thread.join();
+
+    return errors;
+}
+
+std::vector<uint8_t> parallel_inflate(const uint8_t *stream, size_t size, unsigned format,
+                                      const block_index &index, unsigned threads, unsigned &status)
+{
+    unsigned container = format & FORMAT_CONTAINER;
+    std::vector<uint8_t> data;
+
+    status = check_index(stream, size, container, index);
+    if (status != INFLATE_OK)
+        return data;
+
+    data.resize(index.data_size);
+    status = inflate_jobs(stream, container, index, 0, index.offsets.size(), threads, data.data());
+
+    // the trailer, after the last block
+    if (status == INFLATE_OK && container != FORMAT_RAW)
+    {
+        checksum_state checksum;
+        const uint8_t *trailer = stream + index.end + sizeof(LAST_BLOCK);
+
+        checksum_init(checksum);
+        checksum_bytes(checksum, data.data(), data.size());
+        if (container == FORMAT_ZLIB ? byte_swap(get_le(trailer, 4)) != checksum_adler32(checksum)
+                                     : get_le(trailer, 4) != checksum_crc32(checksum) ||
+                                           get_le(trailer + 4, 4) != checksum.size)
+            status |= INFLATE_CHECKSUM_ERROR;
+    }
+
+    return data;
+}
+
+std::vector<uint8_t> inflate_range(const uint8_t *stream, size_t size, unsigned format, const block_index &index,
+                                   size_t offset, size_t length, unsigned threads, unsigned &status)
+{
+    unsigned container = format & FORMAT_CONTAINER;
+    std::vector<uint8_t> data;
+
+    status = check_index(stream, size, container, index);
+    if (status != INFLATE_OK || offset >= index.data_size || length == 0)
+        return data;
+    if (length > index.data_size - offset)
+        length = index.data_size - offset;
+
+    // the jobs that hold the range
+    size_t first = offset / index.job_size;
+    size_t last = (offset + length + index.job_size - 1) / index.job_size;
+
+    data.resize((last - first) * index.job_size);
+    status = inflate_jobs(stream, container, index, first, last, threads, data.data());
+
+    data.erase(data.begin(), data.begin() + (offset - first * index.job_size));
+    data.resize(length);
+
+    return data;
+}
@@ -0,0 +1,232 @@
+/*
+ * File:   parallel_test.cpp
+ *
+ * Test bench of parallel_deflate and parallel_inflate, native build:
+ *
+ *     g++ -O3 -Wno-unknown-pragmas -DDEFLATE_NATIVE -pthread deflate.cpp inflate.cpp checksum.cpp codec.cpp parallel.cpp parallel_test.cpp
+ */
+
+#include "host.h"
+#include "stream_io.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+/*
+ * Data of PARALLEL_TEST_SIZE bytes, not a multiple of MAX_JOB_SIZE, is
+ * compressed in each format by several pools of workers. The test checks
+ * that:
+ *
+ * 1. the stream is the same for every pool;
+ * 2. the output of each job, followed by the last block, inflates back to
+ *    the data of the job (the header is cut from the first one);
+ * 3. the stream ends with the last block and the trailer of the whole data;
+ * 4. empty data gives the header, the sync flush, the last block and the trailer;
+ * 5. parallel_inflate gives the data back with any number of threads, and
+ *    finds a corrupted trailer;
+ * 6. the block index appended to a gzip stream is read back as it was written;
+ * 7. a block index saved on its own is loaded back, and inflate_range gives
+ *    any slice of the data.
+ *
+ * The throughput of each pool is printed too.
+ */
+
+#define PARALLEL_TEST_SIZE (64 * MAX_JOB_SIZE + 1000)
+
+// Inflate a raw stream of one job and compare it with the data of the job
+static bool check_job(const uint8_t *compressed, size_t compressed_size, const uint8_t *data, unsigned size)
+{
+    hls::stream<axi_word> input, output;
+    unsigned status, output_size;
+    unsigned perf[PERF_NUM];
+
+    send_bytes(input, compressed, compressed_size);
+    inflate(input, output, FORMAT_RAW, status, output_size, perf);
+    string decompressed = receive_job(output);
+
+    return status == INFLATE_OK && output_size == size && decompressed == string((const char *)data, size);
+}
+
+// Check the jobs and the end of a stream of 'format'
+static bool check_stream(const std::vector<uint8_t> &stream, const block_index &index, const uint8_t *data,
+                         size_t size, unsigned format)
+{
+    const std::vector<size_t> &offsets = index.offsets;
+    size_t end = stream.size() - TRAILER_BYTES[format];
+    bool isFail = offsets.size() != (size == 0 ? 1 : (size + MAX_JOB_SIZE - 1) / MAX_JOB_SIZE) ||
+                  index.end != end - 2 || index.data_size != size || index.job_size != MAX_JOB_SIZE;
+
+    for (size_t chunk = 0; chunk < offsets.size() && !isFail; chunk++)
+    {
+        size_t start = offsets[chunk] + (chunk == 0 ? HEADER_BYTES[format] : 0);
+        size_t stop = chunk + 1 < offsets.size() ? offsets[chunk + 1] : end - 2;
+        std::vector<uint8_t> job(stream.begin() + start, stream.begin() + stop);
+
+        // the sync flush, then the last block to end the stream
+        isFail |= job.size() < 4 || job[job.size() - 4] != 0x00 || job[job.size() - 3] != 0x00 ||
+                  job[job.size() - 2] != 0xFF || job[job.size() - 1] != 0xFF;
+        job.push_back(0x03);
+        job.push_back(0x00);
+
+        size_t job_start = chunk * MAX_JOB_SIZE;
+        unsigned job_size = size - job_start < MAX_JOB_SIZE ? size - job_start : MAX_JOB_SIZE;
+        isFail |= !check_job(job.data(), job.size(), data + job_start, job_size);
+    }
+
+    // the last block and the trailer
+    checksum_state checksum;
+    checksum_init(checksum);
+    for (size_t i = 0; i < size; i += STREAM_BYTES)
+    {
+        stream_data_t word = 0;
+        for (int k = 0; k < STREAM_BYTES; k++)
+            word = (word << 8) | (i + k < size ? data[i + k] : 0);
+        checksum_update(checksum, word, size - i < STREAM_BYTES ? size - i : STREAM_BYTES);
+    }
+    uint32_t expected[2] = {format == FORMAT_ZLIB ? byte_swap(checksum_adler32(checksum)) : checksum_crc32(checksum),
+                            checksum.size};
+    for (unsigned k = 0; k < TRAILER_BYTES[format]; k++)
+        isFail |= stream[end + k] != (uint8_t)(expected[k / 4] >> (8 * (k % 4)));
+    isFail |= stream[end - 2] != 0x03 || stream[end - 1] != 0x00;
+
+    return !isFail;
+}
+
+int main()
+{
+    std::vector<uint8_t> data(PARALLEL_TEST_SIZE);
+    unsigned seed = 2016;
+    bool isFail = false;
+
+    // text with repeats, then bytes with no matches in the last jobs
+    const char *words[8] = {"prefetch ", "graph ", "the ", "edge ", "vertex ", "queue ", "of ", "breadth-first "};
+    size_t pos = 0;
+    while (pos < data.size())
+    {
+        seed = seed * 1103515245 + 12345;
+        const char *word = pos < data.size() - 3 * MAX_JOB_SIZE ? words[(seed >> 16) % 8] : "?";
+        for (const char *c = word; *c != '\0' && pos < data.size(); c++)
+            data[pos++] = *c == '?' ? (uint8_t)(seed >> 8) : *c;
+    }
+
+    struct
+    {
+        const char *name;
+        unsigned cpus, accelerators;
+    } pools[4] = {{"1 CPU", 1, 0}, {"4 CPUs", 4, 0}, {"2 CPUs + 1 accelerator", 2, 1}, {"all CPUs", 0, 0}};
+
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+    for (unsigned format = FORMAT_RAW; format <= FORMAT_GZIP; format++)
+    {
+        std::vector<uint8_t> first;
+        for (int p = 0; p < 4; p++)
+        {
+            block_index index;
+            std::vector<chunk_worker> workers = make_workers(pools[p].cpus, pools[p].accelerators);
+
+            auto start = std::chrono::steady_clock::now();
+            std::vector<uint8_t> stream = parallel_deflate(data.data(), data.size(), format, workers, &index);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            bool ok = check_stream(stream, index, data.data(), data.size(), format) && (p == 0 || stream == first);
+            printf("format %u, %-24s %zu -> %zu bytes, %6.1f MB/s %s\n", format, pools[p].name, data.size(),
+                   stream.size(), data.size() / seconds / 1e6, ok ? "" : "Fail!");
+            isFail |= !ok;
+            if (p == 0)
+                first = stream;
+        }
+
+        // inflate the stream of the first pool
+        block_index index;
+        parallel_deflate(data.data(), data.size(), format, make_workers(1, 0), &index);
+        unsigned thread_counts[3] = {1, 4, 0};
+        const char *thread_names[3] = {"inflate, 1 thread", "inflate, 4 threads", "inflate, all CPUs"};
+        for (int t = 0; t < 3; t++)
+        {
+            unsigned status;
+            auto start = std::chrono::steady_clock::now();
+            std::vector<uint8_t> decompressed =
+                parallel_inflate(first.data(), first.size(), format, index, thread_counts[t], status);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            bool ok = status == INFLATE_OK && decompressed == data;
+            printf("format %u, %-24s %zu -> %zu bytes, %6.1f MB/s %s\n", format, thread_names[t], first.size(),
+                   decompressed.size(), data.size() / seconds / 1e6, ok ? "" : "Fail!");
+            isFail |= !ok;
+        }
+        if (format != FORMAT_RAW)
+        {
+            unsigned status;
+            first.back() ^= 0x1;
+            parallel_inflate(first.data(), first.size(), format, index, 2, status);
+            if (status != INFLATE_CHECKSUM_ERROR)
+            {
+                cout << "format " << format << ", corrupted trailer Fail!" << endl;
+                isFail = true;
+            }
+        }
+
+        // empty data
+        std::vector<uint8_t> stream = parallel_deflate(NULL, 0, format, make_workers(2, 0), &index);
+        unsigned status;
+        if (!check_stream(stream, index, NULL, 0, format) ||
+            !parallel_inflate(stream.data(), stream.size(), format, index, 2, status).empty() || status != INFLATE_OK)
+        {
+            cout << "format " << format << ", empty data Fail!" << endl;
+            isFail = true;
+        }
+    }
+
+    // the block index after a gzip stream
+    block_index written, read;
+    std::vector<uint8_t> plain = parallel_deflate(data.data(), data.size(), FORMAT_GZIP, make_workers(2, 0));
+    std::vector<uint8_t> indexed =
+        parallel_deflate(data.data(), data.size(), FORMAT_GZIP | FORMAT_BLOCK_INDEX, make_workers(2, 0), &written);
+    unsigned status;
+    bool ok = !read_block_index(plain.data(), plain.size(), read) &&
+              read_block_index(indexed.data(), indexed.size(), read) && read.offsets == written.offsets &&
+              read.end == written.end && read.data_size == written.data_size && read.job_size == written.job_size &&
+              std::equal(plain.begin(), plain.end(), indexed.begin()) &&
+              parallel_inflate(indexed.data(), indexed.size(), FORMAT_GZIP, read, 0, status) == data &&
+              status == INFLATE_OK;
+    printf("gzip block index of %zu jobs, %zu bytes %s\n", read.offsets.size(), indexed.size() - plain.size(),
+           ok ? "" : "Fail!");
+    isFail |= !ok;
+
+    // slices of a zlib stream, through a block index of its own
+    block_index loaded;
+    std::vector<uint8_t> zlib_stream =
+        parallel_deflate(data.data(), data.size(), FORMAT_ZLIB, make_workers(2, 0), &written);
+    std::vector<uint8_t> sidecar = save_block_index(written);
+    ok = load_block_index(sidecar.data(), sidecar.size(), loaded) && loaded.offsets == written.offsets &&
+         loaded.end == written.end && loaded.data_size == written.data_size &&
+         !load_block_index(sidecar.data(), sidecar.size() - 1, loaded);
+
+    // offset and length: in a job, across jobs, past the end, all
+    size_t slices[7][2] = {{0, 1}, {5000, 100}, {MAX_JOB_SIZE - 10, 20}, {3 * MAX_JOB_SIZE, 5 * MAX_JOB_SIZE},
+                           {data.size() - 1, 1}, {data.size() - 500, 1000}, {0, data.size()}};
+    for (int i = 0; i < 7; i++)
+    {
+        size_t offset = slices[i][0], length = std::min(slices[i][1], data.size() - offset);
+        std::vector<uint8_t> slice =
+            inflate_range(zlib_stream.data(), zlib_stream.size(), FORMAT_ZLIB, loaded, offset, slices[i][1], 2, status);
+        ok &= status == INFLATE_OK && slice == std::vector<uint8_t>(data.begin() + offset, data.begin() + offset + length);
+    }
+    ok &= inflate_range(zlib_stream.data(), zlib_stream.size(), FORMAT_ZLIB, loaded, data.size(), 10, 2, status)
+              .empty();
+
+    auto start = std::chrono::steady_clock::now();
+    inflate_range(zlib_stream.data(), zlib_stream.size(), FORMAT_ZLIB, loaded, data.size() / 2, 100, 1, status);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("block index of %zu bytes, 100 bytes read in %.1f us %s\n", sidecar.size(), seconds * 1e6,
+           ok ? "" : "Fail!");
+    isFail |= !ok;
+
+    if (!isFail)
+    {
+        cout << "Parallel Succeed!" << endl;
+    }
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+
+    return isFail ? 1 : 0;
+}
@@ -0,0 +1,478 @@
+/*
+ * File:   runtime.cpp
+ *
+ * Runtime of a Codec instance behind DMA channels, and a device in software.
+ */
+
+#include "host.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+/*
+ * Each job on a device takes three steps: the send channel streams the input
+ * buffer into the core, the core runs, and the receive channel writes the
+ * output stream into the output buffer. jupyter_test.ipynb runs them one
+ * after the other for one job. Here the device runs the steps of different
+ * jobs at once:
+ *
+ *     send channel:    job 1 | job 2 | job 3 |
+ *     Codec:                 | job 1 | job 2 | job 3 |
+ *     receive channel:               | job 1 | job 2 | job 3 |
+ *
+ * as the core can start the next job before the output of the last one is
+ * drained (ap_ctrl_chain). The runtime keeps the device fed: it copies the
+ * next job into free buffers and starts it while the jobs before it run, and
+ * takes the outputs back as they complete.
+ *
+ * The buffers come from an arena, allocated once, instead of a cma_array per
+ * job as in the notebook: the contiguous memory of a device is slow to
+ * allocate and fragments. A job takes the smallest free buffer that holds
+ * its input, and an output buffer of the largest class, and gives them back
+ * when it is polled. A caller can also fill an input buffer itself and take
+ * the output buffer over, with no copy on either side.
+ */
+
+/*
+ * The device in software. Each step has its own thread and takes the jobs in
+ * order; a step starts a job once the step before it is done with the job.
+ * The send channel and the core, and the core and the receive channel, share
+ * a stream, as the hardware does; a step only reads a job once the step
+ * before it wrote the whole of it, as a native stream read cannot wait.
+ */
+class simulated_device : public codec_device
+{
+  public:
+    simulated_device(double dma_bytes_per_second, double job_setup_seconds)
+        : bytes_per_second(dma_bytes_per_second), setup_seconds(job_setup_seconds), started(0), sent(0), computed(0), received(0), retired(0), stop(false)
+    {
+        threads.push_back(std::thread(&simulated_device::send_channel, this));
+        threads.push_back(std::thread(&simulated_device::core, this));
+        threads.push_back(std::thread(&simulated_device::receive_channel, this));
+    }
+
+    ~simulated_device()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        changed.notify_all();
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+
+    void start(unsigned opcode, unsigned format, const stream_data_t *src, unsigned size, stream_data_t *dst,
+               unsigned dst_words)
+    {
+        job next = {opcode, format, src, size, dst, dst_words, 0, 0, {0}};
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(next);
+            started++;
+        }
+        changed.notify_all();
+    }
+
+    bool finish(bool wait, unsigned &size, unsigned &status, unsigned perf[PERF_NUM])
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (wait)
+            changed.wait(lock, [this] { return received > retired; });
+        if (received == retired)
+            return false;
+
+        const job &done = jobs.front();
+        size = done.returned;
+        status = done.status;
+        std::copy(done.perf, done.perf + PERF_NUM, perf);
+        jobs.pop_front();
+        retired++;
+
+        return true;
+    }
+
+  private:
+    struct job
+    {
+        unsigned opcode, format;
+        const stream_data_t *src;
+        unsigned size;
+        stream_data_t *dst;
+        unsigned dst_words;
+        unsigned returned, status; // set by the core
+        unsigned perf[PERF_NUM];
+    };
+
+    // Wait until step 'done' is past job 'index' (or until stop); false on stop
+    bool wait_for(const size_t &done, size_t index)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return done > index || stop; });
+        return !stop;
+    }
+
+    // The job 'index', that the device keeps until it is retired
+    job &at(size_t index)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return jobs[index - retired];
+    }
+
+    void step_done(size_t &done)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done++;
+        }
+        changed.notify_all();
+    }
+
+    // A transfer of 'bytes' over a channel
+    void transfer_time(unsigned bytes)
+    {
+        if (bytes_per_second > 0)
+            std::this_thread::sleep_for(std::chrono::duration<double>(bytes / bytes_per_second));
+    }
+
+    void send_channel()
+    {
+        for (size_t index = 0; wait_for(started, index); index++)
+        {
+            job &next = at(index);
+            unsigned words = next.size == 0 ? 1 : (next.size + STREAM_BYTES - 1) / STREAM_BYTES;
+
+            if (setup_seconds > 0)
+                std::this_thread::sleep_for(std::chrono::duration<double>(setup_seconds));
+            transfer_time(next.size);
+            for (unsigned i = 0; i < words; i++)
+            {
+                unsigned valid_bytes = next.size - i * STREAM_BYTES;
+                valid_bytes = valid_bytes > STREAM_BYTES ? STREAM_BYTES : valid_bytes;
+                core_input.write(make_axi_word(next.size == 0 ? (stream_data_t)0 : next.src[i],
+                                               next.size == 0 ? 0 : valid_bytes, i == words - 1));
+            }
+            step_done(sent);
+        }
+    }
+
+    void core()
+    {
+        for (size_t index = 0; wait_for(sent, index); index++)
+        {
+            job &next = at(index);
+            next.returned = Codec(core_input, core_output, next.opcode, next.format, next.size, next.status, next.perf);
+            step_done(computed);
+        }
+    }
+
+    void receive_channel()
+    {
+        for (size_t index = 0; wait_for(computed, index); index++)
+        {
+            job &next = at(index);
+            axi_word word;
+            unsigned i = 0;
+
+            // words past the end of the buffer are dropped, as with Deflate_mm
+            do
+            {
+                core_output.read(word);
+                if (i < next.dst_words)
+                    next.dst[i] = stream_data(word);
+                i++;
+            } while (!word.last);
+            transfer_time(i * STREAM_BYTES);
+            step_done(received);
+        }
+    }
+
+    double bytes_per_second;
+    double setup_seconds; // of each job on the send channel
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<job> jobs; // started and not retired, oldest first
+    size_t started, sent, computed, received, retired; // jobs started, through each step, and retired
+    bool stop;
+    hls::stream<axi_word> core_input, core_output;
+    std::vector<std::thread> threads;
+};
+
+std::unique_ptr<codec_device> make_simulated_device(double dma_bytes_per_second, double job_setup_seconds)
+{
+    return std::unique_ptr<codec_device>(new simulated_device(dma_bytes_per_second, job_setup_seconds));
+}
+
+buffer_arena::buffer_arena(const unsigned counts[ARENA_CLASSES])
+{
+    unsigned total = 0, words = 0;
+    for (int c = 0; c < ARENA_CLASSES; c++)
+    {
+        total += counts[c];
+        words += counts[c] * ARENA_CLASS_BYTES[c] / STREAM_BYTES;
+    }
+
+    block.resize(words);
+    buffers.reset(new arena_buffer[total]);
+
+    // the buffers of each class one after the other, each class a free list in order
+    unsigned index = 0;
+    words = 0;
+    for (unsigned c = 0; c < ARENA_CLASSES; c++)
+    {
+        free_lists[c].store(counts[c] == 0 ? 0 : index + 1);
+        for (unsigned i = 0; i < counts[c]; i++, index++)
+        {
+            buffers[index].words = &block[words];
+            buffers[index].capacity = ARENA_CLASS_BYTES[c];
+            buffers[index].size_class = c;
+            buffers[index].next.store(i + 1 < counts[c] ? index + 2 : 0);
+            words += ARENA_CLASS_BYTES[c] / STREAM_BYTES;
+        }
+    }
+}
+
+bool buffer_arena::pop(unsigned size_class, arena_buffer *&buffer)
+{
+    uint64_t top = free_lists[size_class].load(std::memory_order_acquire);
+
+    while ((uint32_t)top != 0)
+    {
+        arena_buffer &first = buffers[(uint32_t)top - 1];
+        uint64_t next = ((top >> 32) + 1) << 32 | first.next.load(std::memory_order_relaxed);
+        if (free_lists[size_class].compare_exchange_weak(top, next, std::memory_order_acquire,
+                                                         std::memory_order_acquire))
+        {
+            buffer = &first;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+arena_buffer *buffer_arena::acquire(unsigned bytes)
+{
+    arena_buffer *buffer;
+
+    for (unsigned c = 0; c < ARENA_CLASSES; c++)
+    {
+        if (ARENA_CLASS_BYTES[c] >= bytes && pop(c, buffer))
+            return buffer;
+    }
+
+    return NULL;
+}
+
+void buffer_arena::release(arena_buffer *buffer)
+{
+    std::atomic<uint64_t> &free_list = free_lists[buffer->size_class];
+    uint64_t top = free_list.load(std::memory_order_relaxed);
+    uint64_t index = buffer - buffers.get();
+    uint64_t next;
+
+    do
+    {
+        buffer->next.store((uint32_t)top, std::memory_order_relaxed);
+        next = ((top >> 32) + 1) << 32 | (index + 1);
+    } while (!free_list.compare_exchange_weak(top, next, std::memory_order_release, std::memory_order_relaxed));
+}
+
+codec_runtime::codec_runtime(codec_device &device, buffer_arena &arena, unsigned depth)
+    : device(device), arena(arena), slots(depth == 0 ? 1 : depth), next_ticket(0), submitted(0)
+{
+    for (slot &job : slots)
+        job.state = SLOT_FREE;
+    running.reserve(slots.size());
+}
+
+// Take back the oldest job of the device if it is complete; false if none is
+bool codec_runtime::retire(bool wait)
+{
+    unsigned perf[PERF_NUM];
+
+    if (running.empty())
+        return false;
+
+    slot &done = slots[running.front()];
+    if (!device.finish(wait, done.size, done.status, perf))
+        return false;
+    done.state = SLOT_DONE;
+    running.erase(running.begin());
+
+    return true;
+}
+
+bool codec_runtime::submit(unsigned opcode, unsigned format, const uint8_t *data, unsigned size, unsigned &ticket)
+{
+    arena_buffer *input = arena.acquire(size == 0 ? 1 : size);
+    if (input == NULL)
+        return false;
+
+    // pack the job into the buffer, the first byte at the top of a word
+    for (unsigned i = 0; i < (size + STREAM_BYTES - 1) / STREAM_BYTES; i++)
+    {
+        stream_data_t word = 0;
+        for (int k = 0; k < STREAM_BYTES; k++)
+        {
+            unsigned pos = i * STREAM_BYTES + k;
+            word = (word << 8) | (pos < size ? data[pos] : 0);
+        }
+        input->words[i] = word;
+    }
+
+    if (!submit(opcode, format, input, size, ticket))
+    {
+        arena.release(input);
+        return false;
+    }
+
+    return true;
+}
+
+bool codec_runtime::submit(unsigned opcode, unsigned format, arena_buffer *input, unsigned size, unsigned &ticket)
+{
+    unsigned free_slot = 0;
+    while (free_slot < slots.size() && slots[free_slot].state != SLOT_FREE)
+        free_slot++;
+    if (free_slot == slots.size() || size > MAX_JOB_SIZE || size > input->capacity)
+        return false;
+
+    // an output buffer of the largest class holds the output of any job
+    arena_buffer *output = arena.acquire(ARENA_CLASS_BYTES[ARENA_CLASSES - 1]);
+    if (output == NULL)
+        return false;
+
+    slot &next = slots[free_slot];
+    next.state = SLOT_RUNNING;
+    next.ticket = ticket = next_ticket++;
+    next.src = input;
+    next.dst = output;
+    running.push_back(free_slot);
+    submitted++;
+    device.start(opcode, format, input->words, size, output->words, output->capacity / STREAM_BYTES);
+
+    return true;
+}
+
+// The slot of job 'ticket' once it is complete, NULL if it is not or there is no such job
+codec_runtime::slot *codec_runtime::find(unsigned ticket, bool wait)
+{
+    unsigned index = 0;
+    while (index < slots.size() && (slots[index].state == SLOT_FREE || slots[index].ticket != ticket))
+        index++;
+    if (index == slots.size())
+        return NULL;
+
+    // the jobs complete in order, up to this one
+    slot &job = slots[index];
+    while (job.state == SLOT_RUNNING && retire(wait))
+        ;
+
+    return job.state == SLOT_DONE ? &job : NULL;
+}
+
+bool codec_runtime::poll(unsigned ticket, arena_buffer *&output, unsigned &size, unsigned &status, bool wait)
+{
+    slot *job = find(ticket, wait);
+    if (job == NULL)
+        return false;
+
+    output = job->dst;
+    size = job->size;
+    status = job->status;
+    arena.release(job->src);
+    job->state = SLOT_FREE;
+    submitted--;
+
+    return true;
+}
+
+bool codec_runtime::poll(unsigned ticket, uint8_t *out, unsigned &size, unsigned &status, bool wait)
+{
+    arena_buffer *output;
+    if (!poll(ticket, output, size, status, wait))
+        return false;
+
+    unsigned bytes = std::min(size, output->capacity);
+    for (unsigned pos = 0; pos < bytes; pos++)
+        out[pos] = buffer_byte(*output, pos);
+    arena.release(output);
+
+    return true;
+}
+
+/*
+ * Framed jobs (FORMAT_FRAMED, see deflate.cpp) carry many small messages in
+ * one job, so that the setup of a job is paid once per batch. A batch is cut
+ * so that both its input and the worst case of its output fit a job: each
+ * frame takes its prefix word and its message padded to a word on the input
+ * side, and up to its JOB_OUTPUT_BOUND padded to a word plus its entry of the
+ * size table on the output side.
+ */
+
+// Bytes of 'size' padded to a word
+static size_t word_bytes(size_t size)
+{
+    return (size + STREAM_BYTES - 1) / STREAM_BYTES * STREAM_BYTES;
+}
+
+size_t pack_frames(const std::vector<std::vector<uint8_t>> &messages, size_t first, std::vector<uint8_t> &job)
+{
+    size_t count = 0, output_bytes = 4; // the number of frames ends the size table
+
+    job.clear();
+    while (first + count < messages.size() && count < MAX_FRAMES)
+    {
+        const std::vector<uint8_t> &message = messages[first + count];
+        size_t frame_output = word_bytes(message.size() * 9 / 8 + 32) + 4;
+        if (message.size() > MAX_JOB_SIZE || job.size() + STREAM_BYTES + word_bytes(message.size()) > MAX_JOB_SIZE ||
+            output_bytes + frame_output > JOB_OUTPUT_BOUND)
+            break;
+
+        // the prefix word, the length in its top 32 bits
+        size_t prefix = job.size();
+        job.resize(prefix + STREAM_BYTES + word_bytes(message.size()), 0);
+        for (int k = 0; k < 4; k++)
+            job[prefix + k] = (uint8_t)(message.size() >> (24 - 8 * k));
+        std::copy(message.begin(), message.end(), job.begin() + prefix + STREAM_BYTES);
+
+        output_bytes += frame_output;
+        count++;
+    }
+
+    return count;
+}
+
+// An entry of the size table, first byte at the top
+static uint32_t get_be32(const uint8_t *bytes)
+{
+    return (uint32_t)bytes[0] << 24 | bytes[1] << 16 | bytes[2] << 8 | bytes[3];
+}
+
+bool unpack_frames(const uint8_t *output, size_t size, std::vector<std::vector<uint8_t>> &frames)
+{
+    frames.clear();
+    if (size < 4)
+        return false;
+
+    uint32_t count = get_be32(output + size - 4);
+    if (count > MAX_FRAMES || size < (count + 1) * 4)
+        return false;
+
+    const uint8_t *table = output + size - (count + 1) * 4;
+    size_t pos = 0;
+    for (uint32_t f = 0; f < count; f++)
+    {
+        uint32_t frame_size = get_be32(table + 4 * f);
+        if (frame_size > (size_t)(table - output) - pos)
+            return false;
+        frames.push_back(std::vector<uint8_t>(output + pos, output + pos + frame_size));
+        pos += word_bytes(frame_size);
+    }
+
+    return pos == (size_t)(table - output);
+}
@@ -0,0 +1,332 @@
+/*
+ * File:   runtime_test.cpp
+ *
+ * Test bench of codec_runtime on the simulated device, and of buffer_arena,
+ * native build:
+ *
+ *     g++ -O3 -Wno-unknown-pragmas -DDEFLATE_NATIVE -pthread deflate.cpp inflate.cpp checksum.cpp codec.cpp parallel.cpp runtime.cpp runtime_test.cpp
+ */
+
+#include "host.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <thread>
+
+/*
+ * The test checks that:
+ *
+ * 1. compression jobs in each format give the same bytes as the core run
+ *    directly (cpu_worker), and decompression jobs give the data back;
+ * 2. submit refuses a job while 'depth' jobs are in flight, and jobs can be
+ *    polled in any order;
+ * 3. a job with an unknown opcode gives CODEC_OPCODE_ERROR and the next job
+ *    runs as usual;
+ * 4. a job can be filled in an arena buffer and its output taken over, and
+ *    submit refuses a job when the arena is out of buffers;
+ * 5. the arena gives the smallest class that fits, NULL when a class and the
+ *    ones above are used up, and never the same buffer to two threads;
+ * 6. small messages packed into framed jobs give the same streams as one job
+ *    per message, and a message too long for a batch is sent on its own.
+ *
+ * Then the same jobs run with transfers as slow as the core, at depth 1
+ * (one job at a time, as the notebook) and 2 and 3; and the small messages
+ * run one job each and in batches on a device with a setup time per job.
+ * The times are printed.
+ */
+
+#define RUNTIME_TEST_JOBS 48
+#define DMA_BYTES_PER_SECOND 20e6
+#define ARENA_TEST_THREADS 4
+#define ARENA_TEST_ROUNDS 100000
+#define BATCH_TEST_MESSAGES 400
+#define JOB_SETUP_SECONDS 50e-6
+
+static const unsigned ARENA_COUNTS[ARENA_CLASSES] = {8, 8, 8};
+
+struct test_job
+{
+    unsigned opcode, format;
+    std::vector<uint8_t> input, expected;
+};
+
+// Run the jobs on a runtime of 'depth', polling the oldest job when submit refuses; false on a wrong output
+static bool run_jobs(codec_device &device, unsigned depth, const std::vector<test_job> &jobs)
+{
+    buffer_arena arena(ARENA_COUNTS);
+    codec_runtime runtime(device, arena, depth);
+    std::vector<unsigned> tickets(jobs.size());
+    std::vector<uint8_t> out(JOB_OUTPUT_BOUND);
+    size_t next = 0, done = 0;
+    bool isFail = false;
+
+    while (done < jobs.size())
+    {
+        if (next < jobs.size() && runtime.submit(jobs[next].opcode, jobs[next].format, jobs[next].input.data(),
+                                                 jobs[next].input.size(), tickets[next]))
+        {
+            next++;
+            continue;
+        }
+
+        unsigned size, status;
+        runtime.poll(tickets[done], out.data(), size, status, true);
+        isFail |= status != INFLATE_OK || size != jobs[done].expected.size() ||
+                  !std::equal(jobs[done].expected.begin(), jobs[done].expected.end(), out.begin());
+        done++;
+    }
+
+    return !isFail && runtime.in_flight() == 0;
+}
+
+// Compress the messages on a runtime of depth 2, one job each or packed in
+// framed jobs; false if a stream is not the expected one
+static bool run_messages(codec_device &device, const std::vector<std::vector<uint8_t>> &messages, unsigned format,
+                         bool batched, const std::vector<std::vector<uint8_t>> &expected)
+{
+    struct pending_job
+    {
+        unsigned ticket;
+        size_t first, count; // messages of the job, framed if count > 0
+    };
+
+    buffer_arena arena(ARENA_COUNTS);
+    codec_runtime runtime(device, arena, 2);
+    std::deque<pending_job> pending;
+    std::vector<uint8_t> job, out(JOB_OUTPUT_BOUND);
+    std::vector<std::vector<uint8_t>> frames;
+    size_t next = 0;
+    bool isFail = false;
+
+    while (next < messages.size() || !pending.empty())
+    {
+        if (next < messages.size())
+        {
+            pending_job submitted = {0, next, batched ? pack_frames(messages, next, job) : 0};
+            bool started = submitted.count > 0
+                               ? runtime.submit(OP_DEFLATE, format | FORMAT_FRAMED, job.data(), job.size(), submitted.ticket)
+                               : runtime.submit(OP_DEFLATE, format, messages[next].data(), messages[next].size(),
+                                                submitted.ticket);
+            if (started)
+            {
+                next += submitted.count > 0 ? submitted.count : 1;
+                pending.push_back(submitted);
+                continue;
+            }
+        }
+
+        unsigned size, status;
+        pending_job done = pending.front();
+        pending.pop_front();
+        runtime.poll(done.ticket, out.data(), size, status, true);
+        if (done.count == 0)
+        {
+            frames.assign(1, std::vector<uint8_t>(out.begin(), out.begin() + size));
+            done.count = 1;
+        }
+        else
+            isFail |= !unpack_frames(out.data(), size, frames) || frames.size() != done.count;
+        for (size_t f = 0; !isFail && f < done.count; f++)
+            isFail |= frames[f] != expected[done.first + f];
+    }
+
+    return !isFail;
+}
+
+int main()
+{
+    std::vector<uint8_t> data(RUNTIME_TEST_JOBS / 2 * MAX_JOB_SIZE);
+    std::vector<test_job> jobs;
+    unsigned seed = 2016;
+    bool isFail = false;
+
+    const char *words[8] = {"prefetch ", "graph ", "the ", "edge ", "vertex ", "queue ", "of ", "breadth-first "};
+    size_t pos = 0;
+    while (pos < data.size())
+    {
+        seed = seed * 1103515245 + 12345;
+        for (const char *c = words[(seed >> 16) % 8]; *c != '\0' && pos < data.size(); c++)
+            data[pos++] = *c;
+    }
+
+    // a compression and a decompression job per chunk, the last chunk short
+    chunk_worker reference = cpu_worker();
+    for (int i = 0; i < RUNTIME_TEST_JOBS / 2; i++)
+    {
+        unsigned size = i == RUNTIME_TEST_JOBS / 2 - 1 ? 777 : MAX_JOB_SIZE;
+        unsigned format = i % 3;
+        test_job deflate_job = {OP_DEFLATE, format, std::vector<uint8_t>(data.begin() + i * MAX_JOB_SIZE,
+                                                                         data.begin() + i * MAX_JOB_SIZE + size),
+                                std::vector<uint8_t>(JOB_OUTPUT_BOUND)};
+        deflate_job.expected.resize(reference(deflate_job.input.data(), size, format, deflate_job.expected.data()));
+        test_job inflate_job = {OP_INFLATE, format, deflate_job.expected, deflate_job.input};
+        jobs.push_back(deflate_job);
+        jobs.push_back(inflate_job);
+    }
+
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+    std::unique_ptr<codec_device> device = make_simulated_device();
+    for (unsigned depth = 1; depth <= 3; depth++)
+    {
+        if (!run_jobs(*device, depth, jobs))
+        {
+            cout << "depth " << depth << ", jobs Fail!" << endl;
+            isFail = true;
+        }
+    }
+
+    // a full runtime, polled out of order, then an unknown opcode
+    buffer_arena arena(ARENA_COUNTS);
+    codec_runtime runtime(*device, arena, 2);
+    std::vector<uint8_t> out(JOB_OUTPUT_BOUND);
+    unsigned tickets[3], size, status;
+    bool ok = runtime.submit(jobs[0].opcode, jobs[0].format, jobs[0].input.data(), jobs[0].input.size(), tickets[0]) &&
+              runtime.submit(jobs[1].opcode, jobs[1].format, jobs[1].input.data(), jobs[1].input.size(), tickets[1]) &&
+              !runtime.submit(jobs[2].opcode, jobs[2].format, jobs[2].input.data(), jobs[2].input.size(), tickets[2]);
+    ok &= runtime.poll(tickets[1], out.data(), size, status, true) && status == INFLATE_OK &&
+          size == jobs[1].expected.size() && std::equal(jobs[1].expected.begin(), jobs[1].expected.end(), out.begin());
+    ok &= runtime.poll(tickets[0], out.data(), size, status) && status == INFLATE_OK &&
+          size == jobs[0].expected.size() && std::equal(jobs[0].expected.begin(), jobs[0].expected.end(), out.begin());
+    ok &= runtime.submit(7, FORMAT_RAW, data.data(), 100, tickets[2]) &&
+          runtime.poll(tickets[2], out.data(), size, status, true) && status == CODEC_OPCODE_ERROR;
+    ok &= runtime.submit(jobs[0].opcode, jobs[0].format, jobs[0].input.data(), jobs[0].input.size(), tickets[0]) &&
+          runtime.poll(tickets[0], out.data(), size, status, true) && status == INFLATE_OK &&
+          size == jobs[0].expected.size() && runtime.in_flight() == 0;
+    if (!ok)
+    {
+        cout << "submit and poll Fail!" << endl;
+        isFail = true;
+    }
+
+    // a job filled in place, its output taken over; then the arena used up
+    arena_buffer *input = arena.acquire(jobs[0].input.size()), *output = NULL;
+    for (unsigned i = 0; i < jobs[0].input.size(); i++)
+        set_buffer_byte(*input, i, jobs[0].input[i]);
+    ok = runtime.submit(jobs[0].opcode, jobs[0].format, input, jobs[0].input.size(), tickets[0]) &&
+         runtime.poll(tickets[0], output, size, status, true) && status == INFLATE_OK &&
+         size == jobs[0].expected.size();
+    for (unsigned i = 0; ok && i < size; i++)
+        ok &= buffer_byte(*output, i) == jobs[0].expected[i];
+    arena.release(output);
+
+    std::vector<arena_buffer *> taken;
+    while ((output = arena.acquire(ARENA_CLASS_BYTES[ARENA_CLASSES - 1])) != NULL)
+        taken.push_back(output);
+    ok &= taken.size() == ARENA_COUNTS[ARENA_CLASSES - 1] &&
+          !runtime.submit(jobs[1].opcode, jobs[1].format, jobs[1].input.data(), 100, tickets[1]);
+    for (arena_buffer *buffer : taken)
+        arena.release(buffer);
+    if (!ok)
+    {
+        cout << "zero-copy jobs Fail!" << endl;
+        isFail = true;
+    }
+
+    // classes, then threads taking and giving back buffers at once
+    buffer_arena shared(ARENA_COUNTS);
+    arena_buffer *small = shared.acquire(1), *middle = shared.acquire(ARENA_CLASS_BYTES[0] + 1);
+    ok = small->size_class == 0 && middle->size_class == 1 && shared.acquire(ARENA_CLASS_BYTES[2] + 1) == NULL;
+    shared.release(small);
+    shared.release(middle);
+
+    // each buffer has an owner count, by its place among the buffers
+    std::atomic<int> owners[ARENA_COUNTS[0] + ARENA_COUNTS[1] + ARENA_COUNTS[2]];
+    taken.clear();
+    while ((output = shared.acquire(1)) != NULL)
+        taken.push_back(output);
+    arena_buffer *first = *std::min_element(taken.begin(), taken.end());
+    for (arena_buffer *buffer : taken)
+        shared.release(buffer);
+    for (std::atomic<int> &owner : owners)
+        owner.store(0);
+    std::vector<std::thread> threads;
+    std::atomic<bool> twice(false);
+    for (int t = 0; t < ARENA_TEST_THREADS; t++)
+    {
+        threads.push_back(std::thread([&, t] {
+            unsigned seed = t;
+            for (int round = 0; round < ARENA_TEST_ROUNDS; round++)
+            {
+                seed = seed * 1103515245 + 12345;
+                arena_buffer *buffer = shared.acquire((seed >> 16) % ARENA_CLASS_BYTES[ARENA_CLASSES - 1] + 1);
+                if (buffer == NULL)
+                    continue;
+                std::atomic<int> &owner = owners[buffer - first];
+                if (owner.fetch_add(1) != 0)
+                    twice = true;
+                owner.fetch_sub(1);
+                shared.release(buffer);
+            }
+        }));
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    taken.clear();
+    while ((output = shared.acquire(1)) != NULL)
+        taken.push_back(output);
+    ok &= !twice && taken.size() == ARENA_COUNTS[0] + ARENA_COUNTS[1] + ARENA_COUNTS[2];
+    if (!ok)
+    {
+        cout << "arena Fail!" << endl;
+        isFail = true;
+    }
+
+    // small messages, one job of MAX_JOB_SIZE among them; then a size table that does not match
+    std::vector<std::vector<uint8_t>> messages, expected;
+    for (int m = 0; m < BATCH_TEST_MESSAGES; m++)
+    {
+        seed = seed * 1103515245 + 12345;
+        size_t begin = (seed >> 8) % (data.size() - MAX_JOB_SIZE);
+        size_t length = m == BATCH_TEST_MESSAGES / 2 ? MAX_JOB_SIZE : m % 50 == 0 ? 0 : 16 + (seed >> 20) % 144;
+        messages.push_back(std::vector<uint8_t>(data.begin() + begin, data.begin() + begin + length));
+        expected.push_back(std::vector<uint8_t>(JOB_OUTPUT_BOUND));
+        expected.back().resize(reference(messages.back().data(), length, FORMAT_ZLIB, expected.back().data()));
+    }
+    std::vector<uint8_t> batch;
+    std::vector<std::vector<uint8_t>> frames;
+    size_t packed = pack_frames(messages, 0, batch);
+    ok = packed > 1 && pack_frames(messages, BATCH_TEST_MESSAGES / 2, batch) == 0 &&
+         run_messages(*device, messages, FORMAT_ZLIB, true, expected);
+    batch.assign(4, 0);
+    batch[3] = 1;
+    ok &= !unpack_frames(batch.data(), batch.size(), frames);
+    if (!ok)
+    {
+        cout << "framed jobs Fail!" << endl;
+        isFail = true;
+    }
+
+    // transfers as slow as the core: overlapped at depth 2 and 3
+    std::unique_ptr<codec_device> slow_device = make_simulated_device(DMA_BYTES_PER_SECOND);
+    for (unsigned depth = 1; depth <= 3; depth++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        ok = run_jobs(*slow_device, depth, jobs);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("depth %u, %d jobs with DMA at %.0f MB/s: %.1f ms %s\n", depth, RUNTIME_TEST_JOBS,
+               DMA_BYTES_PER_SECOND / 1e6, seconds * 1e3, ok ? "" : "Fail!");
+        isFail |= !ok;
+    }
+
+    // a setup time per job: one job per message, then batches
+    std::unique_ptr<codec_device> setup_device = make_simulated_device(DMA_BYTES_PER_SECOND, JOB_SETUP_SECONDS);
+    for (int batched = 0; batched <= 1; batched++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        ok = run_messages(*setup_device, messages, FORMAT_ZLIB, batched, expected);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%d messages %s, %.0f us setup per job: %.1f ms %s\n", BATCH_TEST_MESSAGES,
+               batched ? "in framed jobs" : "one job each", JOB_SETUP_SECONDS * 1e6, seconds * 1e3, ok ? "" : "Fail!");
+        isFail |= !ok;
+    }
+
+    if (!isFail)
+    {
+        cout << "Runtime Succeed!" << endl;
+    }
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+
+    return isFail ? 1 : 0;
+}
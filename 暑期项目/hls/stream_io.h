@@ -0,0 +1,74 @@
+/*
+ * File:   stream_io.h
+ *
+ * Jobs in and out of the AXI-Stream ports of the cores, as a DMA would move
+ * them, for the test benches and the host side.
+ */
+
+#ifndef STREAM_IO_H
+#define STREAM_IO_H
+
+#include "deflate.h"
+#include <string>
+
+// Send 'size' bytes to a core, STREAM_BYTES bytes per word with TLAST on the
+// last word; an empty job is one word without valid bytes
+inline void send_bytes(hls::stream<axi_word> &input, const uint8_t *data, unsigned size)
+{
+    unsigned words = size == 0 ? 1 : (size + STREAM_BYTES - 1) / STREAM_BYTES;
+
+    for (unsigned i = 0; i < words; i++)
+    {
+        stream_data_t word = 0;
+        unsigned valid_bytes = 0;
+        for (int k = 0; k < STREAM_BYTES; k++)
+        {
+            unsigned pos = i * STREAM_BYTES + k;
+            word = (word << 8) | (pos < size ? data[pos] : 0);
+            valid_bytes += pos < size;
+        }
+        input.write(make_axi_word(word, valid_bytes, i == words - 1));
+    }
+}
+
+// Receive the bytes of a core up to TLAST, the valid bytes only; returns the number of bytes
+inline unsigned receive_bytes(hls::stream<axi_word> &output, uint8_t *out)
+{
+    axi_word word;
+    unsigned size = 0;
+
+    do
+    {
+        output.read(word);
+        stream_data_t data = stream_data(word);
+        for (unsigned k = 0; k < stream_valid_bytes(word); k++)
+            out[size++] = stream_byte(data, k);
+    } while (!word.last);
+
+    return size;
+}
+
+// Send a job held in a string
+inline void send_job(hls::stream<axi_word> &input, const string &data)
+{
+    send_bytes(input, (const uint8_t *)data.data(), data.size());
+}
+
+// Receive a job up to TLAST into a string, the valid bytes only
+inline string receive_job(hls::stream<axi_word> &output)
+{
+    axi_word word;
+    string data;
+
+    do
+    {
+        output.read(word);
+        stream_data_t word_data = stream_data(word);
+        for (unsigned k = 0; k < stream_valid_bytes(word); k++)
+            data.push_back(stream_byte(word_data, k));
+    } while (!word.last);
+
+    return data;
+}
+
+#endif
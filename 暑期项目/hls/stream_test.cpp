@@ -0,0 +1,104 @@
+/*
+ * File:   stream_test.cpp
+ *
+ * Test bench of continued streams (FORMAT_CONTINUE) through the Codec top level.
+ */
+
+#include "stream_io.h"
+#include <vector>
+
+/*
+ * Log lines are compressed as one stream in each container, a job per line
+ * with the sync flush, and an empty last job ends the stream. The output of
+ * each line must end on a flush point (an empty stored block), and the whole
+ * stream must decompress back to the lines, its trailer included. With the
+ * history of the earlier lines, the stream must be smaller than the lines
+ * compressed as jobs of their own. Then a job without FORMAT_CONTINUE must
+ * start a stream of its own again.
+ */
+
+#define NUM_LINES 16
+
+// Compress one job of 'format'
+static string compress(hls::stream<axi_word> &input, hls::stream<axi_word> &output, const string &data,
+                       unsigned format)
+{
+    unsigned status, perf[PERF_NUM];
+
+    send_job(input, data);
+    unsigned size = Codec(input, output, OP_DEFLATE, format, data.size(), status, perf);
+    string compressed = receive_job(output);
+
+    return compressed.size() == size ? compressed : string();
+}
+
+int main(void)
+{
+    const char *levels[3] = {"INFO", "WARN", "DEBUG"};
+    const char *events[4] = {"request served", "cache miss on key", "connection reset by peer", "retrying upload"};
+
+    hls::stream<axi_word> input, output;
+    unsigned status, perf[PERF_NUM];
+    bool isFail = false;
+
+    vector<string> lines;
+    string all_lines;
+    for (int l = 0; l < NUM_LINES; l++)
+    {
+        string line = string("2016-07-") + (char)('1' + l / 9) + (char)('0' + l % 9) + " 10:52:0" + (char)('0' + l % 7) +
+                      " [" + levels[l % 3] + "] worker-" + (char)('0' + l % 4) + ": " + events[(l * 3) % 4] +
+                      (l % 5 == 0 ? " (queue depth 12, window 4096 bytes, job size 4096 bytes)" : "") + "\n";
+        lines.push_back(line);
+        all_lines += line;
+    }
+
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+
+    for (unsigned format = FORMAT_RAW; format <= FORMAT_GZIP; format++)
+    {
+        string stream, alone;
+        bool flushed = true;
+
+        for (int l = 0; l < NUM_LINES; l++)
+        {
+            string part = compress(input, output, lines[l], format | FORMAT_SYNC_FLUSH | (l > 0 ? FORMAT_CONTINUE : 0));
+            flushed &= part.size() >= 4 && part.substr(part.size() - 4) == string("\x00\x00\xFF\xFF", 4);
+            stream += part;
+        }
+        stream += compress(input, output, string(), format | FORMAT_CONTINUE);
+        for (int l = 0; l < NUM_LINES; l++)
+            alone += compress(input, output, lines[l], format | FORMAT_SYNC_FLUSH);
+
+        send_job(input, stream);
+        unsigned decompressed_size = Codec(input, output, OP_INFLATE, format, 0, status, perf);
+        string decompressed = receive_job(output);
+
+        cout << "format " << format << ": " << all_lines.size() << " bytes in " << NUM_LINES << " flushes -> "
+             << stream.size() << " bytes, " << alone.size() << " bytes without the history" << endl;
+        if (!flushed || status != INFLATE_OK || decompressed_size != all_lines.size() || decompressed != all_lines ||
+            stream.size() >= alone.size())
+        {
+            isFail = true;
+            cout << "Stream Fail! Format " << format << ", status " << status << endl;
+        }
+    }
+
+    // a new stream after the continued ones
+    string compressed = compress(input, output, lines[1], FORMAT_ZLIB);
+    send_job(input, compressed);
+    unsigned decompressed_size = Codec(input, output, OP_INFLATE, FORMAT_ZLIB, 0, status, perf);
+    if (receive_job(output) != lines[1] || decompressed_size != lines[1].size() || status != INFLATE_OK ||
+        compressed != compress(input, output, lines[1], FORMAT_ZLIB))
+    {
+        isFail = true;
+        cout << "Stream Fail! New stream after the continued ones." << endl;
+    }
+
+    if (!isFail)
+    {
+        cout << "Stream Succeed!" << endl;
+    }
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+
+    return isFail ? 1 : 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * File:   throughput_test.cpp
+ *
+ * Test bench of the cycle model: predicted throughput of both cores on a file.
+ */
+
+#include "stream_io.h"
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <vector>
+
+/*
+ * usage: throughput_test [file] [format]
+ *
+ * The file is cut into jobs of MAX_JOB_SIZE bytes, compressed with Deflate()
+ * and decompressed again with inflate(), checking the round trip. The cycle
+ * model (cycle_model.cpp) then reports the iterations of each loop and the
+ * predicted bytes/cycle and MB/s of each core. Without a file, a built-in
+ * paragraph is used, so the test bench also runs in C simulation without
+ * arguments. The native build has no cycle model, so it only checks the
+ * round trip.
+ */
+
+int main(int argc, char **argv)
+{
+    string text =
+        "To evaluate our prefetcher we modelled the system using the gem5 simulator [4] in full system mode with the setup "
+        "given in table 2 and the ARMv8 64-bit instruction set. Our applications are derived from existing benchmarks and "
+        "libraries for graph traversal, using a range of graph sizes and characteristics. We simulate the core breadth-first search "
+        "based kernels of each benchmark, skipping the graph construction phase. Our first benchmark is from the Graph 500 community [32]. "
+        "We used their Kronecker graph generator for both the standard Graph 500 search benchmark and a connected components "
+        "calculation. The Graph 500 benchmark is designed to represent data analytics workloads, such as 3D physics "
+        "simulation. Standard inputs are too long to simulate, so we create smaller graphs with scales from 16 to 21 and edge "
+        "factors from 5 to 15 (for comparison, the Graph 500 toy input has scale 26 and edge factor 16).";
+    unsigned format = argc > 2 ? atoi(argv[2]) : FORMAT_RAW;
+
+    if (argc > 1)
+    {
+        ifstream file(argv[1], ios::binary);
+        if (!file)
+        {
+            cout << "cannot open " << argv[1] << endl;
+            return 1;
+        }
+        stringstream content;
+        content << file.rdbuf();
+        text = content.str();
+    }
+
+    hls::stream<axi_word> input, output;
+    unsigned perf[PERF_NUM];
+    unsigned status, size;
+    unsigned jobs = text.size() == 0 ? 1 : (text.size() + MAX_JOB_SIZE - 1) / MAX_JOB_SIZE;
+    vector<string> compressed(jobs);
+    uint64_t compressed_bytes = 0;
+    bool isFail = false;
+
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+    model_reset();
+
+    /************************* Deflate compression ****************************/
+    for (unsigned j = 0; j < jobs; j++)
+    {
+        string job = text.substr(j * MAX_JOB_SIZE, MAX_JOB_SIZE);
+        send_job(input, job);
+        Deflate(input, output, format, job.size(), perf);
+        compressed[j] = receive_job(output);
+        compressed_bytes += compressed[j].size();
+        model_end_job();
+    }
+    model_report("Deflate", text.size());
+
+    /************************* inflate decompression **************************/
+    for (unsigned j = 0; j < jobs; j++)
+    {
+        send_job(input, compressed[j]);
+        inflate(input, output, format, status, size, perf);
+        string job = receive_job(output);
+        model_end_job();
+
+        job.resize(size < job.size() ? size : job.size());
+        if (status != INFLATE_OK || job != text.substr(j * MAX_JOB_SIZE, MAX_JOB_SIZE))
+        {
+            isFail = true;
+            cout << "Round trip Fail! Job " << j << ", status " << status << endl;
+        }
+    }
+    model_report("inflate", text.size());
+
+    cout << "compression ratio " << (double)text.size() / (compressed_bytes == 0 ? 1 : compressed_bytes) << endl;
+    if (!isFail)
+    {
+        cout << "Round trip Succeed!" << endl;
+    }
+    cout << "//////////////////////////////////////////////////////////////" << endl;
+
+    return isFail ? 1 : 0;
+}